@@ -7,6 +7,8 @@
 // Written by John Shepherd, March 2019
 
 #include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
 #include "defs.h"
 #include "bits.h"
 #include "page.h"
@@ -14,13 +16,13 @@
 #define BYTE_NBITS 8
 
 typedef struct _BitsRep {
-	Count  nbits;		  // how many bits
+	BigCount nbits;		  // how many bits
 	Count  nbytes;		  // how many bytes in array
 	Byte   bitstring[1];  // array of bytes to hold bits
 	                      // actual array size is nbytes
 } BitsRep;
 
-static Byte *getByte(Bits b, int position) 
+static Byte *getByte(Bits b, BigCount position) 
 {
         return &b->bitstring[position / BYTE_NBITS];
 }
@@ -28,17 +30,18 @@ static Byte *getByte(Bits b, int position)
 /*
  * Returns the offset of a bit within a byte. 
  */
-static int getOffset(int position) 
+static int getOffset(BigCount position) 
 {
         return position % BYTE_NBITS;
 }
 
 // create a new Bits object
 
-Bits newBits(int nbits)
+Bits newBits(BigCount nbits)
 {
-	Count nbytes = iceil(nbits, BYTE_NBITS);
-	Bits new = malloc(2*sizeof(Count) + nbytes);
+	Count nbytes = (nbits + BYTE_NBITS - 1) / BYTE_NBITS;
+	Bits new = malloc(offsetof(BitsRep, bitstring) + nbytes);
+	assert(new != NULL);
 	new->nbits = nbits;
 	new->nbytes = nbytes;
 	memset(&(new->bitstring[0]), 0, nbytes);
@@ -54,12 +57,12 @@ void freeBits(Bits b)
 
 // check if the bit at position is 1
 
-Bool bitIsSet(Bits b, int position)
+Bool bitIsSet(Bits b, BigCount position)
 {
 	assert(b != NULL);
-	assert(0 <= position && position < b->nbits);
+	assert(position < b->nbits);
 	assert(b != NULL);
-	assert(0 <= position && position < b->nbits);
+	assert(position < b->nbits);
         Byte *byte = getByte(b, position);
         Byte mask = 1 << getOffset(position);
 	return (*byte & mask) != 0; 
@@ -85,12 +88,33 @@ Bool isSubset(Bits b1, Bits b2)
         return subset;
 }
 
+// check whether Bits b is a subset of the bit-string at bytes
+// (of the same length), a 64-bit word at a time; words of bytes
+// where b has no bits set are never read
+
+Bool isSubsetOfBytes(Bits b, Byte *bytes)
+{
+	assert(b != NULL && bytes != NULL);
+	Count i = 0;
+	for (; i + sizeof(uint64_t) <= b->nbytes; i += sizeof(uint64_t)) {
+		uint64_t w, s;
+		memcpy(&w, &b->bitstring[i], sizeof(w));
+		if (w == 0) continue;
+		memcpy(&s, &bytes[i], sizeof(s));
+		if ((w & s) != w) return FALSE;
+	}
+	for (; i < b->nbytes; i++) {
+		if ((b->bitstring[i] & bytes[i]) != b->bitstring[i]) return FALSE;
+	}
+	return TRUE;
+}
+
 // set the bit at position to 1
 
-void setBit(Bits b, int position)
+void setBit(Bits b, BigCount position)
 {
 	assert(b != NULL);
-	assert(0 <= position && position < b->nbits);
+	assert(position < b->nbits);
         Byte *byte = getByte(b, position);
         *byte |= (1 << getOffset(position));
 }
@@ -106,10 +130,10 @@ void setAllBits(Bits b)
 
 // set the bit at position to 0
 
-void unsetBit(Bits b, int position)
+void unsetBit(Bits b, BigCount position)
 {
 	assert(b != NULL);
-	assert(0 <= position && position < b->nbits);
+	assert(position < b->nbits);
         Byte *byte = getByte(b, position);
         Byte mask = ~(1 << getOffset(position));
         *byte &= mask;
@@ -275,7 +299,26 @@ Count nBytes(Bits b)
         return b->nbytes;
 }
 
-Count nBits(Bits b) 
+BigCount nBits(Bits b) 
 {
         return b->nbits;
 }
+
+// address of the bytes holding the bits (LSB in byte 0)
+
+Byte *bitsAddr(Bits b)
+{
+        return b->bitstring;
+}
+
+// count how many bits are set to 1
+
+BigCount nBitsSet(Bits b)
+{
+        assert(b != NULL);
+        BigCount n = 0;
+        for (Count i = 0; i < b->nbytes; i++) {
+                n += __builtin_popcount(b->bitstring[i]);
+        }
+        return n;
+}
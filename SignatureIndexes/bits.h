@@ -11,13 +11,14 @@ typedef struct _BitsRep *Bits;
 #include "defs.h"
 #include "page.h"
 
-Bits newBits(int);
+Bits newBits(BigCount);
 void freeBits(Bits);
-Bool bitIsSet(Bits, int);
+Bool bitIsSet(Bits, BigCount);
 Bool isSubset(Bits, Bits);
-void setBit(Bits, int);
+Bool isSubsetOfBytes(Bits, Byte *);
+void setBit(Bits, BigCount);
 void setAllBits(Bits);
-void unsetBit(Bits, int);
+void unsetBit(Bits, BigCount);
 void unsetAllBits(Bits);
 void andBits(Bits, Bits);
 void orBits(Bits, Bits);
@@ -27,6 +28,8 @@ void putBits(Page, Offset, Bits);
 void showBits(Bits);
 void showHexBits(Bits);
 Count nBytes(Bits);
-Count nBits(Bits);
+BigCount nBits(Bits);
+Byte *bitsAddr(Bits);
+BigCount nBitsSet(Bits);
 
 #endif
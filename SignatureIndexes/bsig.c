@@ -2,22 +2,203 @@
 // part of signature indexed files
 // Written by John Shepherd, March 2019
 
+#include <stdint.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 #include "defs.h"
 #include "reln.h"
 #include "query.h"
 #include "bsig.h"
 #include "psig.h"
 
+// Bit-slices are maintained a block of SLICE_BLOCK data pages at a
+// time: psigs of new tuples are OR'd into an in-memory block, which
+// is transposed into one 64-bit word per slice and merged into the
+// bsig pages in one sequential pass when the block is flushed
+
+#define SLICE_BLOCK 64
+
+// transpose a block of n (<= 64) signatures of size bytes each
+// into size*8 64-bit words: bit j of words[i] is bit i of sigs[j]
+
+void transposeSigs(Byte *sigs, Count n, Count size, uint64_t *words)
+{
+	assert(n <= 64);
+	Byte col[64];  // byte k of each signature
+	for (Count k = 0; k < size; k++) {
+		Byte any = 0;
+		for (Count j = 0; j < 64; j++) {
+			col[j] = (j < n) ? sigs[j*size + k] : 0;
+			any |= col[j];
+		}
+		uint64_t *w = &words[k*8];
+		for (int b = 0; b < 8; b++) w[b] = 0;
+		if (any == 0) continue;
+#ifdef __SSE2__
+		// movemask collects the top bit of 16 bytes at once;
+		// doubling the bytes moves the next bit to the top
+		for (int q = 0; q < 4; q++) {
+			__m128i v = _mm_loadu_si128((__m128i *)&col[16*q]);
+			for (int b = 7; b >= 0; b--) {
+				uint64_t m = (uint16_t)_mm_movemask_epi8(v);
+				w[b] |= m << (16*q);
+				v = _mm_add_epi8(v, v);
+			}
+		}
+#else
+		for (Count j = 0; j < n; j++) {
+			Byte byte = col[j];
+			while (byte != 0) {
+				w[__builtin_ctz(byte)] |= (uint64_t)1 << j;
+				byte &= byte - 1;
+			}
+		}
+#endif
+	}
+}
+
+// merge words for nblocks consecutive blocks of data pages, starting
+// at data page base (a multiple of SLICE_BLOCK), into the bit-slices
+// words[i*nblocks + b] holds the bits of slice i for block b
+// each bsig page is read and written at most once
+
+static void mergeSliceWords(Reln r, uint64_t *words, Count nblocks, PageID base)
+{
+	RelnParams *rp = &(r->params);
+	Count off = base / 8;
+	Count nbytes = nblocks * 8;
+	if (off + nbytes > rp->bsigSize) nbytes = rp->bsigSize - off;
+	for (PageID pid = 0; pid < nBsigPages(r); pid++) {
+		Count first = pid * rp->bsigPP;
+		Count last = first + rp->bsigPP;
+		if (last > rp->pm) last = rp->pm;
+		Count i;
+		for (i = first*nblocks; i < last*nblocks; i++)
+			if (words[i] != 0) break;
+		if (i == last*nblocks) continue;
+		Page p = getPage(bsigFile(r), pid);
+		for (i = first; i < last; i++) {
+			Byte *slice = addrInPage(p, i - first, rp->bsigSize) + off;
+			uint64_t *w = &words[i*nblocks];
+			for (Count k = 0; k < nbytes; k++)
+				slice[k] |= (Byte)(w[k/8] >> (8*(k%8)));
+		}
+		putPage(bsigFile(r), pid, p);
+	}
+}
+
+// merge the pending block of psigs into the bit-slices
+
+void flushBitSlices(Reln r)
+{
+	if (r->pending == NULL) return;
+	RelnParams *rp = &(r->params);
+	uint64_t *words = malloc(rp->pm * sizeof(uint64_t));
+	assert(words != NULL);
+	transposeSigs(r->pending, SLICE_BLOCK, rp->psigSize, words);
+	mergeSliceWords(r, words, 1, r->pendFrom);
+	free(words);
+	free(r->pending);
+	r->pending = NULL;
+}
+
+// bring the bit-slices up to date with the psig file
+// with deferred bit-slices (DEFER_BSIG), inserts only update psigs;
+// the psigs of data pages from the high-water mark onwards are then
+// folded into the slices here, SYNC_PAGES data pages per pass
+// (an insert into a page below the mark lowers the mark to it)
+// data pages beyond the first bm can't be recorded (see reindex)
+
+#define SYNC_PAGES 1024  // multiple of SLICE_BLOCK
+
+void syncBitSlices(Reln r)
+{
+	RelnParams *rp = &(r->params);
+	flushBitSlices(r);
+	// slices only have room for bm data pages
+	Count upto = (nPages(r) < bsigBits(r)) ? nPages(r) : bsigBits(r);
+	if (rp->bsigSynced >= upto) return;
+
+	PageID from = rp->bsigSynced - rp->bsigSynced % SLICE_BLOCK;
+	Count maxblocks = SYNC_PAGES / SLICE_BLOCK;
+	Byte *psigs = malloc(SYNC_PAGES * rp->psigSize);
+	uint64_t *block = malloc(rp->pm * sizeof(uint64_t));
+	uint64_t *words = malloc(rp->pm * maxblocks * sizeof(uint64_t));
+	assert(psigs != NULL && block != NULL && words != NULL);
+	Page psigpage = NULL;
+	PageID psigpid = NO_PAGE;
+	for (PageID base = from; base < upto; base += SYNC_PAGES) {
+		Count n = upto - base;
+		if (n > SYNC_PAGES) n = SYNC_PAGES;
+		for (Count i = 0; i < n; i++) {
+			PageID pid = base + i;
+			if (pid / rp->psigPP != psigpid) {
+				if (psigpage != NULL) free(psigpage);
+				psigpid = pid / rp->psigPP;
+				psigpage = getPage(psigFile(r), psigpid);
+			}
+			memcpy(psigs + i*rp->psigSize,
+			       addrInPage(psigpage, pid % rp->psigPP, rp->psigSize), rp->psigSize);
+		}
+		Count nblocks = iceil(n, SLICE_BLOCK);
+		for (Count b = 0; b < nblocks; b++) {
+			Count nb = n - b*SLICE_BLOCK;
+			if (nb > SLICE_BLOCK) nb = SLICE_BLOCK;
+			transposeSigs(psigs + b*SLICE_BLOCK*rp->psigSize, nb, rp->psigSize, block);
+			for (Count i = 0; i < rp->pm; i++)
+				words[i*nblocks + b] = block[i];
+		}
+		mergeSliceWords(r, words, nblocks, base);
+	}
+	if (psigpage != NULL) free(psigpage);
+	free(psigs); free(block); free(words);
+	rp->bsigSynced = upto;
+}
+
+// record that psig has been added to data page pid
+// the bit-slices are updated when the block of pages is flushed
+
+void addToBitSlices(Reln r, PageID pid, Bits psig)
+{
+	RelnParams *rp = &(r->params);
+	assert(pid < bsigBits(r));
+	if (r->pending != NULL && pid / SLICE_BLOCK != r->pendFrom / SLICE_BLOCK)
+		flushBitSlices(r);
+	if (r->pending == NULL) {
+		r->pending = calloc(SLICE_BLOCK, rp->psigSize);
+		assert(r->pending != NULL);
+		r->pendFrom = pid - pid % SLICE_BLOCK;
+	}
+	Byte *dest = r->pending + (pid - r->pendFrom) * rp->psigSize;
+	Byte *src = bitsAddr(psig);
+	for (Count k = 0; k < rp->psigSize; k++)
+		dest[k] |= src[k];
+}
+
 void findPagesUsingBitSlices(Query q)
 {
 	assert(q != NULL);
-        Bits qsig = makePageSig(q->rel, q->qstring);
+	// readers can't update the slices; unsynced pages stay candidates
+	if (!q->rel->snapshot) syncBitSlices(q->rel);
+        // each slice is read once, and AND'd into the candidate
+        // pages of every disjunct whose query signature needs it
+        Count nq = q->ndisjuncts;
+        Bits *qsigs = querySigs(q, makePageSig);
+        Bits *found = malloc(nq * sizeof(Bits));
+        assert(found != NULL);
+        for (Count d = 0; d < nq; d++) {
+                found[d] = newBits(nPages(q->rel));
+                setAllBits(found[d]);
+        }
         Bits bsig = newBits(bsigBits(q->rel));
-        setAllBits(q->pages);
         Page bsigpage = NULL;
         PageID bsigpid = -1;
         for (Count i = 0; i < psigBits(q->rel); i++) {
-                if (!bitIsSet(qsig, i)) continue;
+                Count d;
+                for (d = 0; d < nq; d++)
+                        if (bitIsSet(qsigs[d], i)) break;
+                if (d == nq) continue;
 
                 if (bsigpid != i / maxBsigsPP(q->rel)) {
                         if (bsigpage != NULL) 
@@ -29,15 +210,25 @@ void findPagesUsingBitSlices(Query q)
 
                 q->nsigs++;
                 getBits(bsigpage, i % maxBsigsPP(q->rel), bsig);
-                for (Count j = 0; j < nPages(q->rel); j++) {
-                        if(!bitIsSet(bsig, j)) {
-                                unsetBit(q->pages, j);
+                // pages not in the slices (beyond bm) stay candidates
+                for (; d < nq; d++) {
+                        if (!bitIsSet(qsigs[d], i)) continue;
+                        for (PageID j = 0; j < q->rel->params.bsigSynced; j++) {
+                                if(!bitIsSet(bsig, j)) {
+                                        unsetBit(found[d], j);
+                                }
                         }
                 }
         }
 
+        unsetAllBits(q->pages);
+        for (Count d = 0; d < nq; d++) {
+                orBits(q->pages, found[d]);
+                freeBits(found[d]);
+        }
+        free(found);
         if (bsigpage != NULL) free(bsigpage);
         free(bsig);
-        free(qsig);
+        freeQuerySigs(q, qsigs);
 }
 
@@ -5,11 +5,16 @@
 #ifndef BSIG_H
 #define BSIG_H 1
 
+#include <stdint.h>
 #include "defs.h"
 #include "query.h"
 #include "reln.h"
 #include "bits.h"
 
+void transposeSigs(Byte *, Count, Count, uint64_t *);
+void flushBitSlices(Reln);
+void syncBitSlices(Reln);
+void addToBitSlices(Reln, PageID, Bits);
 void findPagesUsingBitSlices(Query);
 
 #endif
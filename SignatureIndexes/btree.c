@@ -0,0 +1,446 @@
+// btree.c ... B+-tree index on one attribute
+// part of signature indexed files
+// Maps values of attribute battr to the data pages holding them,
+// in value order, so that range predicates "lo..hi" can be answered
+//
+// Index entries are (key, data PageID) pairs, one per distinct
+// (value, page) combination, ordered by compareVals() on the key
+// and then by PageID. Keys longer than BT_KEYLEN-1 chars are
+// truncated, which can only add candidate pages, never lose them.
+//
+// Every node is one page in the .btree file. Item 0 of a node is
+// a header: key[0] is BT_LEAF or BT_INTERNAL, and child is the next
+// leaf (leaves) or the child holding entries below the first
+// separator (internal nodes). In internal nodes, entry i's child
+// holds all entries >= (key,pid) of entry i and < entry i+1.
+
+#include <unistd.h>
+#include <sys/file.h>
+#include "defs.h"
+#include "btree.h"
+#include "reln.h"
+#include "query.h"
+#include "tuple.h"
+#include "page.h"
+#include "bits.h"
+
+#define BT_KEYLEN   24
+#define BT_LEAF     'L'
+#define BT_INTERNAL 'I'
+#define BT_MAXDEPTH 32
+
+typedef struct _BtEntry {
+        char    key[BT_KEYLEN];  // attribute value ('\0'-terminated)
+        PageID  pid;             // data page holding that value
+        PageID  child;           // child node (internal nodes only)
+} BtEntry;
+
+static BtEntry *entryAt(Page p, Count i)
+{
+        return (BtEntry *)addrInPage(p, i, sizeof(BtEntry));
+}
+
+static int cmpEntry(BtEntry *a, BtEntry *b)
+{
+        int c = compareVals(a->key, b->key);
+        if (c != 0) return c;
+        return (a->pid < b->pid) ? -1 : (a->pid > b->pid);
+}
+
+static int cmpEntryQsort(const void *a, const void *b)
+{
+        return cmpEntry((BtEntry *)a, (BtEntry *)b);
+}
+
+// build a node page from a header and entries
+
+static Page makeNode(Reln r, char type, PageID link, BtEntry *ents, Count n)
+{
+        Page p = newPage(btreeFile(r));
+        BtEntry *hdr = entryAt(p, 0);
+        hdr->key[0] = type;
+        hdr->child = link;
+        addOneItem(p);
+        for (Count i = 0; i < n; i++) {
+                *entryAt(p, i+1) = ents[i];
+                addOneItem(p);
+        }
+        return p;
+}
+
+static Bool isLeaf(Page p)
+{
+        return entryAt(p, 0)->key[0] == BT_LEAF;
+}
+
+// append a node to the index file, return its PageID
+
+static PageID appendNode(Reln r, Page p)
+{
+        PageID pid = r->params.btNpages;
+        Page tmp = getNewLastPage(&(r->params.btNpages), btreeFile(r));
+        free(tmp);
+        putPage(btreeFile(r), pid, p);
+        return pid;
+}
+
+// child of internal node p that may hold entry e
+
+static PageID childFor(Page p, BtEntry *e)
+{
+        PageID c = entryAt(p, 0)->child;
+        for (Count i = 1; i < pageNitems(p); i++) {
+                if (cmpEntry(entryAt(p, i), e) > 0) break;
+                c = entryAt(p, i)->child;
+        }
+        return c;
+}
+
+static void makeEntry(BtEntry *e, char *val, PageID pid)
+{
+        memset(e, 0, sizeof(BtEntry));
+        snprintf(e->key, BT_KEYLEN, "%s", val);
+        e->pid = pid;
+        e->child = NO_PAGE;
+}
+
+// insert entry e into node pid, splitting it if it is full
+// returns TRUE if node split; *sep is then the entry to push
+// into the parent (its child is the new right node)
+
+static Bool insertIntoNode(Reln r, PageID pid, BtEntry *e, BtEntry *sep)
+{
+        Page p = getPage(btreeFile(r), pid);
+        char type = entryAt(p, 0)->key[0];
+        PageID link = entryAt(p, 0)->child;
+        Count n = pageNitems(p) - 1;
+        BtEntry *ents = malloc((n+1) * sizeof(BtEntry));
+        assert(ents != NULL);
+        Count pos = 0;
+        for (Count i = 0; i < n; i++) {
+                ents[i] = *entryAt(p, i+1);
+                if (cmpEntry(&ents[i], e) < 0) pos = i+1;
+        }
+        free(p);
+        memmove(&ents[pos+1], &ents[pos], (n-pos) * sizeof(BtEntry));
+        ents[pos] = *e;
+        n++;
+
+        if (n <= r->params.btentPP) {
+                putPage(btreeFile(r), pid, makeNode(r, type, link, ents, n));
+                free(ents);
+                return FALSE;
+        }
+
+        Count half = n / 2;
+        PageID right;
+        if (type == BT_LEAF) {
+                // right leaf gets upper half; first entry is copied up
+                right = appendNode(r, makeNode(r, BT_LEAF, link, &ents[half], n-half));
+                putPage(btreeFile(r), pid, makeNode(r, BT_LEAF, right, ents, half));
+                *sep = ents[half];
+        }
+        else {
+                // middle separator moves up; its child leads the right node
+                right = appendNode(r, makeNode(r, BT_INTERNAL, ents[half].child,
+                                               &ents[half+1], n-half-1));
+                putPage(btreeFile(r), pid, makeNode(r, BT_INTERNAL, link, ents, half));
+                *sep = ents[half];
+        }
+        sep->child = right;
+        free(ents);
+        return TRUE;
+}
+
+// open the index file of a relation that has a B+-tree
+
+void openBtreeIndex(Reln r)
+{
+        btreeFile(r) = openRelnFile(r, "btree");
+}
+
+void closeBtreeIndex(Reln r)
+{
+        if (btreeFile(r) >= 0) close(btreeFile(r));
+        btreeFile(r) = -1;
+}
+
+// keep track of the range of numeric keys (for cost estimates)
+
+static void addToBtreeRange(Reln r, char *val)
+{
+        RelnParams *rp = &(r->params);
+        char *end;
+        double x = strtod(val, &end);
+        if (*val == '\0' || *end != '\0') {
+                rp->btnumeric = FALSE;
+                return;
+        }
+        if (rp->nbtentries == 0 || x < rp->btmin) rp->btmin = x;
+        if (rp->nbtentries == 0 || x > rp->btmax) rp->btmax = x;
+}
+
+// create a B+-tree on attribute attr of a relation
+// bulk-loads entries for all tuples already in the data file:
+// sort them, pack them into leaves, then build each level above
+
+void newBtreeIndex(Reln r, Count attr)
+{
+        RelnParams *rp = &(r->params);
+        assert(!hasOption(r, BTREE_INDEX) && attr < nAttrs(r));
+        openBtreeIndex(r);
+        rp->options |= BTREE_INDEX;
+        rp->battr = attr;
+        rp->btentPP = (pageSize(r) - sizeof(Count)) / sizeof(BtEntry) - 1;
+        rp->btNpages = rp->nbtentries = 0;
+        rp->btnumeric = TRUE;
+
+        // collect and sort all entries
+        Count n = 0, max = 1024;
+        BtEntry *ents = malloc(max * sizeof(BtEntry));
+        assert(ents != NULL);
+        for (PageID pid = 0; pid < nPages(r); pid++) {
+                Page p = getPage(dataFile(r), pid);
+                for (Count i = 0; i < pageNitems(p); i++) {
+                        if (tupleIsDeleted(r, p, i)) continue;
+                        Tuple t = getTupleFromPage(r, p, i);
+                        char **vals = tupleVals(r, t);
+                        if (n == max) {
+                                max *= 2;
+                                ents = realloc(ents, max * sizeof(BtEntry));
+                                assert(ents != NULL);
+                        }
+                        makeEntry(&ents[n++], vals[attr], pid);
+                        freeVals(vals, nAttrs(r));
+                        free(t);
+                }
+                free(p);
+        }
+        qsort(ents, n, sizeof(BtEntry), cmpEntryQsort);
+        Count ndistinct = 0;
+        for (Count i = 0; i < n; i++) {
+                if (ndistinct > 0 && cmpEntry(&ents[ndistinct-1], &ents[i]) == 0)
+                        continue;
+                ents[ndistinct++] = ents[i];
+                addToBtreeRange(r, ents[i].key);
+                rp->nbtentries++;
+        }
+        n = ndistinct;
+
+        // leaves, chained left to right
+        Count perNode = rp->btentPP;
+        Count nnodes = (n == 0) ? 1 : iceil(n, perNode);
+        PageID first = rp->btNpages;
+        for (Count i = 0; i < nnodes; i++) {
+                Count lo = i*perNode, cnt = (n - lo < perNode) ? n - lo : perNode;
+                PageID next = (i == nnodes-1) ? NO_PAGE : first + i + 1;
+                appendNode(r, makeNode(r, BT_LEAF, next, &ents[lo], cnt));
+        }
+        rp->btDepth = 1;
+
+        // internal levels: one separator per child except the first
+        while (nnodes > 1) {
+                BtEntry *seps = malloc(nnodes * sizeof(BtEntry));
+                assert(seps != NULL);
+                for (Count i = 0; i < nnodes; i++) {
+                        Page p = getPage(btreeFile(r), first + i);
+                        seps[i] = *entryAt(p, 1);
+                        seps[i].child = first + i;
+                        free(p);
+                }
+                // each internal node holds perNode separators + leftmost child
+                Count nparents = iceil(nnodes, perNode + 1);
+                PageID pfirst = rp->btNpages;
+                for (Count i = 0; i < nparents; i++) {
+                        Count lo = i*(perNode+1);
+                        Count cnt = (nnodes - lo < perNode+1) ? nnodes - lo : perNode+1;
+                        appendNode(r, makeNode(r, BT_INTERNAL, seps[lo].child,
+                                               &seps[lo+1], cnt-1));
+                }
+                free(seps);
+                first = pfirst;
+                nnodes = nparents;
+                rp->btDepth++;
+        }
+        rp->btRoot = first;
+        free(ents);
+}
+
+// record that tuple t is stored in data page pid
+
+void addToBtreeIndex(Reln r, Tuple t, PageID pid)
+{
+        RelnParams *rp = &(r->params);
+        char **vals = tupleVals(r, t);
+        BtEntry e;
+        makeEntry(&e, vals[rp->battr], pid);
+        freeVals(vals, nAttrs(r));
+
+        // descend to leaf, remembering the path
+        PageID path[BT_MAXDEPTH];
+        Count depth = 0;
+        PageID cur = rp->btRoot;
+        for (;;) {
+                Page p = getPage(btreeFile(r), cur);
+                if (isLeaf(p)) {
+                        // skip entries already in the index
+                        for (Count i = 1; i < pageNitems(p); i++) {
+                                if (cmpEntry(entryAt(p, i), &e) == 0) {
+                                        free(p);
+                                        return;
+                                }
+                        }
+                        free(p);
+                        break;
+                }
+                assert(depth < BT_MAXDEPTH);
+                path[depth++] = cur;
+                PageID next = childFor(p, &e);
+                free(p);
+                cur = next;
+        }
+
+        addToBtreeRange(r, e.key);
+        rp->nbtentries++;
+        BtEntry sep;
+        if (!insertIntoNode(r, cur, &e, &sep)) return;
+        while (depth > 0) {
+                cur = path[--depth];
+                BtEntry up = sep;
+                if (!insertIntoNode(r, cur, &up, &sep)) return;
+        }
+        // root split: new root above old root and its new sibling
+        rp->btRoot = appendNode(r, makeNode(r, BT_INTERNAL, rp->btRoot, &sep, 1));
+        rp->btDepth++;
+}
+
+// remove the entry recording that tuple t's key is in data page pid
+// leaves are not merged when they become under-full
+
+void removeFromBtreeIndex(Reln r, Tuple t, PageID pid)
+{
+        RelnParams *rp = &(r->params);
+        char **vals = tupleVals(r, t);
+        BtEntry e;
+        makeEntry(&e, vals[rp->battr], pid);
+        freeVals(vals, nAttrs(r));
+
+        PageID cur = rp->btRoot;
+        Page p = getPage(btreeFile(r), cur);
+        while (!isLeaf(p)) {
+                cur = childFor(p, &e);
+                free(p);
+                p = getPage(btreeFile(r), cur);
+        }
+        Count n = pageNitems(p) - 1;
+        BtEntry *ents = malloc((n+1) * sizeof(BtEntry));
+        assert(ents != NULL);
+        Count nkeep = 0;
+        for (Count i = 1; i <= n; i++) {
+                if (cmpEntry(entryAt(p, i), &e) == 0) continue;
+                ents[nkeep++] = *entryAt(p, i);
+        }
+        if (nkeep < n) {
+                putPage(btreeFile(r), cur, makeNode(r, BT_LEAF, entryAt(p, 0)->child, ents, nkeep));
+                rp->nbtentries--;
+        }
+        free(p);
+        free(ents);
+}
+
+// can the B+-tree answer this query?
+// i.e. relation has a B+-tree and query constrains its attribute
+
+Bool btreeIndexUsable(Query q)
+{
+        if (!hasOption(q->rel, BTREE_INDEX)) return FALSE;
+        char **vals = tupleVals(q->rel, q->qstring);
+        char *val = vals[q->rel->params.battr];
+        Bool usable = !isUnknownVal(val) && !isPatternVal(val);
+        freeVals(vals, nAttrs(q->rel));
+        return usable;
+}
+
+// get the (inclusive) key range for a query; "" means unbounded
+
+static void queryRange(Query q, char *lo, char *hi)
+{
+        char **vals = tupleVals(q->rel, q->qstring);
+        char *val = vals[q->rel->params.battr];
+        if (!rangeBounds(val, lo, hi, BT_KEYLEN)) {
+                snprintf(lo, BT_KEYLEN, "%s", val);
+                strcpy(hi, lo);
+        }
+        freeVals(vals, nAttrs(q->rel));
+}
+
+// estimated fraction of index entries that satisfy the query
+// numeric ranges interpolate between the smallest and largest keys;
+// other ranges use the traditional guess of 1/3
+
+double btreeSelectivity(Query q)
+{
+        RelnParams *rp = &(q->rel->params);
+        char lo[BT_KEYLEN], hi[BT_KEYLEN];
+        queryRange(q, lo, hi);
+        if (strcmp(lo, hi) == 0)
+                return (rp->nbtentries == 0) ? 0.0 : 1.0 / rp->nbtentries;
+        if (!rp->btnumeric || rp->btmax <= rp->btmin) return 1.0/3;
+        double l = (lo[0] == '\0') ? rp->btmin : atof(lo);
+        double h = (hi[0] == '\0') ? rp->btmax : atof(hi);
+        if (l < rp->btmin) l = rp->btmin;
+        if (h > rp->btmax) h = rp->btmax;
+        if (h < l) return 0.0;
+        return (h - l + 1) / (rp->btmax - rp->btmin + 1);
+}
+
+// find pages with values in the query's range for the indexed attribute
+
+void findPagesUsingBtree(Query q)
+{
+        assert(q != NULL && btreeIndexUsable(q));
+        Reln r = q->rel;
+        char lo[BT_KEYLEN], hi[BT_KEYLEN];
+        queryRange(q, lo, hi);
+        unsetAllBits(q->pages);
+
+        // nodes may be split meanwhile (see readIndexParams)
+        flock(btreeFile(r), LOCK_SH);
+        readIndexParams(r);
+
+        // descend to first leaf that may hold entries >= lo
+        BtEntry start;
+        makeEntry(&start, lo, 0);
+        PageID cur = r->params.btRoot;
+        Page p;
+        for (;;) {
+                p = getPage(btreeFile(r), cur);
+                q->nsigpages++;
+                if (isLeaf(p)) break;
+                cur = (lo[0] == '\0') ? entryAt(p, 0)->child : childFor(p, &start);
+                free(p);
+        }
+
+        // scan leaves until a key beyond hi
+        for (;;) {
+                for (Count i = 1; i < pageNitems(p); i++) {
+                        BtEntry *e = entryAt(p, i);
+                        q->nsigs++;
+                        if (lo[0] != '\0' && compareVals(e->key, lo) < 0) continue;
+                        if (hi[0] != '\0' && compareVals(e->key, hi) > 0) {
+                                free(p);
+                                flock(btreeFile(r), LOCK_UN);
+                                return;
+                        }
+                        if (e->pid < nPages(r)) setBit(q->pages, e->pid);
+                }
+                PageID next = entryAt(p, 0)->child;
+                free(p);
+                if (next == NO_PAGE) {
+                        flock(btreeFile(r), LOCK_UN);
+                        return;
+                }
+                p = getPage(btreeFile(r), next);
+                q->nsigpages++;
+        }
+}
@@ -0,0 +1,21 @@
+// btree.h ... interface to the B+-tree index
+// part of signature indexed files
+// See btree.c for details of the index structure
+
+#ifndef BTREE_H
+#define BTREE_H 1
+
+#include "defs.h"
+#include "query.h"
+#include "reln.h"
+
+void newBtreeIndex(Reln, Count);
+void openBtreeIndex(Reln);
+void closeBtreeIndex(Reln);
+void addToBtreeIndex(Reln, Tuple, PageID);
+void removeFromBtreeIndex(Reln, Tuple, PageID);
+Bool btreeIndexUsable(Query);
+double btreeSelectivity(Query);
+void findPagesUsingBtree(Query);
+
+#endif
@@ -1,19 +1,37 @@
 // create.c ... create an empty Relation
 // part of superimposed codeword signature files
 // Ask a query on a named file
-// Usage:  ./create  RelName  #attrs  1/pF
+// Usage:  ./create  [-h]  [-b AttrNo]  [-d]  [-f]  [-g AttrNo]...  [-p PageSize]  [-s Schema]  [-t]  [-z]  RelName  SigType  #tuples  #attrs  1/pF
 // where #attrs = #attributes in each tuple
 //		tupSize = #bytes in each tuple
 //		  pF = inverse of false match prob
+//		  -h = also build a hash index on attribute 0
+//		  -b = also build a B+-tree on attribute AttrNo (0..#attrs-1)
+//		  -d = defer bit-slice updates until they're needed (see sync-bsig)
+//		  -f = also keep frame-sliced signatures (one frame per attribute)
+//		  -g = add trigram codewords for attribute AttrNo to signatures,
+//		       for pattern queries like "abc*" or "*abc*" (simc/blkc only)
+// SigType is catc, simc or blkc (like simc, but each codeword sits
+// in one 64-byte block, so a scan reads fewer bytes of each signature)
+//		  -p = bytes per page in all of the relation's files
+//		       (a multiple of 4096, up to 1048576; default 4096)
+//		  -s = store tuples in binary, with the attribute types in Schema,
+//		       e.g. "int32,char(20),char(6),int64" (see tuple.c)
+//		  -t = also keep tuple bit-slices (tsigs transposed, see tbsig.c)
+//		  -z = also keep zone maps (per-page min/max of numeric values)
 
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
-#include <math.h>
 #include "util.h"
 #include "reln.h"
+#include "lhash.h"
+#include "btree.h"
+#include "fsig.h"
+#include "zone.h"
+#include "tbsig.h"
 
-#define USAGE "./create  RelName  SigType  #tuples  #attrs  1/pF"
+#define USAGE "./create  [-h]  [-b AttrNo]  [-d]  [-f]  [-g AttrNo]...  [-p PageSize]  [-s Schema]  [-t]  [-z]  RelName  SigType  #tuples  #attrs  1/pF"
 
 
 // Main ... process args, run query
@@ -25,14 +43,65 @@ int main(int argc, char **argv)
 
 	// Process command-line args
 
+	Bool hashed = FALSE;  // build hash index?
+	Bool deferred = FALSE;  // defer bit-slice updates?
+	Bool framed = FALSE;  // keep frame-sliced signatures?
+	Bool zoned = FALSE;   // keep zone maps?
+	Bool sliced = FALSE;  // keep tuple bit-slices?
+	Count ngramAttrs = 0;  // attributes with n-gram codewords
+	int battr = -1;       // attribute for B+-tree (-1 if none)
+	char *schema = NULL;  // attribute types (NULL for untyped tuples)
+	int pagesize = PAGESIZE;  // bytes per page
+	while (argc > 1 && argv[1][0] == '-') {
+		if (strcmp(argv[1], "-h") == 0)
+			hashed = TRUE;
+		else if (strcmp(argv[1], "-d") == 0)
+			deferred = TRUE;
+		else if (strcmp(argv[1], "-f") == 0)
+			framed = TRUE;
+		else if (strcmp(argv[1], "-z") == 0)
+			zoned = TRUE;
+		else if (strcmp(argv[1], "-t") == 0)
+			sliced = TRUE;
+		else if (strcmp(argv[1], "-g") == 0 && argc > 2) {
+			int attr = atoi(argv[2]);
+			if (attr < 0 || attr >= MAXATTRS) {
+				sprintf(err, "Invalid n-gram attribute: %d (must be < #attrs)", attr);
+				fatal("", err);
+			}
+			ngramAttrs |= 1 << attr;
+			argc--; argv++;
+		}
+		else if (strcmp(argv[1], "-p") == 0 && argc > 2) {
+			pagesize = atoi(argv[2]);
+			argc--; argv++;
+		}
+		else if (strcmp(argv[1], "-s") == 0 && argc > 2) {
+			schema = argv[2];
+			argc--; argv++;
+		}
+		else if (strcmp(argv[1], "-b") == 0 && argc > 2) {
+			char *end;
+			battr = strtol(argv[2], &end, 10);
+			if (end == argv[2] || *end != '\0' || battr < 0 || battr >= MAXATTRS) {
+				sprintf(err, "Invalid -b attribute: %.20s (must be < #attrs)", argv[2]);
+				fatal("", err);
+			}
+			argc--; argv++;
+		}
+		else
+			fatal(USAGE, "");
+		argc--; argv++;
+	}
 	if (argc < 6) fatal(USAGE, "");
 
-    // signature type (simc or catc)
-    if ((strcmp(argv[2], "simc") == 0) || (strcmp(argv[2],"catc") == 0)) {
+    // signature type (simc, catc or blkc)
+    if ((strcmp(argv[2], "simc") == 0) || (strcmp(argv[2],"catc") == 0)
+        || (strcmp(argv[2], "blkc") == 0)) {
         stype = argv[2][0];
     }
 	else {
-        sprintf(err, "Invalid signature type (must be simc or catc)");
+        sprintf(err, "Invalid signature type (must be simc, catc or blkc)");
 		fatal("",err);
     }
 
@@ -45,8 +114,43 @@ int main(int argc, char **argv)
 
 	// how many attributes in each tuple
 	int nattrs = atoi(argv[4]);
-	if (nattrs < 2 || nattrs > 9) {
-		sprintf(err, "Invalid #attrs: %d (must be 1 < # < 10)", nattrs);
+	if (nattrs < 2 || nattrs > MAXATTRS) {
+		sprintf(err, "Invalid #attrs: %d (must be 1 < # < %d)", nattrs, MAXATTRS+1);
+		fatal("", err);
+	}
+	if (ngramAttrs >= (1 << nattrs)) {
+		sprintf(err, "Invalid n-gram attribute (must be < #attrs)");
+		fatal("", err);
+	}
+	if (ngramAttrs != 0 && stype == 'c') {
+		sprintf(err, "N-gram codewords need simc or blkc signatures");
+		fatal("", err);
+	}
+	char types[MAXATTRS];
+	Count lens[MAXATTRS], tupsize = TEXT_TUPSIZE(nattrs);
+	if (schema != NULL) {
+		if (parseSchema(schema, nattrs, types, lens) != OK) {
+			sprintf(err, "Invalid schema: %.100s (need %d of int32, int64, char(N))",
+			        schema, nattrs);
+			fatal("", err);
+		}
+		tupsize = 0;
+		for (int i = 0; i < nattrs; i++) {
+			tupsize += lens[i];
+			if ((ngramAttrs & (1 << i)) && types[i] != CHAR_ATTR) {
+				sprintf(err, "N-gram codewords need a char attribute (not %d)", i);
+				fatal("", err);
+			}
+		}
+	}
+	if (battr >= nattrs) {
+		sprintf(err, "Invalid -b attribute: %d (must be < #attrs)", battr);
+		fatal("", err);
+	}
+
+	if (pagesize < MINPAGESIZE || pagesize > MAXPAGESIZE || pagesize%MINPAGESIZE != 0) {
+		sprintf(err, "Invalid page size: %d (must be a multiple of %d, up to %d)",
+		        pagesize, MINPAGESIZE, MAXPAGESIZE);
 		fatal("", err);
 	}
 
@@ -58,30 +162,35 @@ int main(int argc, char **argv)
 	}
 
 	// compute parameters, based on argv
-	// all tuples look like:
-	// 7-digits,20-alphas,6-alphanum,... up to nattrs
-	Count tsize = 28 + 7*(nattrs-2);
-	Count capacity = (PAGESIZE-sizeof(Count))/tsize;
-	double log2 = 1.0/log(2.0);
-	double logF = log(1.0/(double)pF);
-	Count tk  = (int)(log2 * logF);
-	Count tm  = (int)(log2*log2 * nattrs * logF);
-	Count pm  = (int)(log2*log2 * nattrs*capacity * logF);
-	// HACK: we need a value for bm, but bm = #pages
-	// HACK: we have no pages yet, so set bit-slices to 4K bits
-	// HACK:   assuming that we never need more than 4K data pages
-	Count bm  = ntuples / capacity;
-	if (ntuples%capacity > 0) bm++;
+	Count tk, tm, pm, bm;
+	double psigF = chooseSigParams(nattrs, tupsize, pF, ntuples, ngramAttrs, pagesize,
+	                               &tk, &tm, &pm, &bm);
+	if (psigF > pF)
+		fprintf(stderr, "Page signatures cut to %d bits to fit the pages; "
+		        "their false match probability is about %.3g\n", pm, psigF);
 
 	// create relation, unless it exists already
 	if (existsRelation(argv[1])) {
 		sprintf(err, "Relation %s already exists", argv[1]);
 		fatal("", err);
 	}
-	if (newRelation(argv[1], nattrs, pF, stype, tk, tm, pm, bm) != OK) {
+	if (newRelation(argv[1], nattrs, pF, stype, tk, tm, pm, bm, pagesize) != OK) {
 		sprintf(err, "Problems while creating relation %s", argv[1]);
 		fatal("", err);
 	}
+	if (hashed || battr >= 0 || deferred || framed || zoned || sliced || ngramAttrs != 0
+	    || schema != NULL) {
+		Reln r = openRelation(argv[1]);
+		r->params.ngramAttrs = ngramAttrs;
+		if (schema != NULL) setSchema(&r->params, types, lens);
+		if (deferred) r->params.options |= DEFER_BSIG;
+		if (framed) newFrameSigs(r);
+		if (zoned) newZoneMaps(r);
+		if (sliced) newTupleSlices(r);
+		if (hashed) newHashIndex(r);
+		if (battr >= 0) newBtreeIndex(r, battr);
+		closeRelation(r);
+	}
 
 	return OK;
 }
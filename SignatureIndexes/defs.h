@@ -12,8 +12,10 @@
 #include <assert.h>
 #include "util.h"
 
-#define PAGESIZE    4096
-#define NO_PAGE     0xffffffff
+#define PAGESIZE    4096     // default page size
+#define MINPAGESIZE 4096
+#define MAXPAGESIZE 1048576
+#define NO_PAGE     0xffffffffffffffffULL
 #define MAXERRMSG   200
 #define MAXTUPLEN   200
 #define MAXRELNAME  200
@@ -30,6 +32,7 @@ typedef int File;
 typedef unsigned int Offset;
 typedef unsigned int Count;
 typedef unsigned int Word;
-typedef Offset PageID;
+typedef unsigned long long PageID;    // 64-bit, for multi-GB files
+typedef unsigned long long BigCount;  // #tuples, #signatures, ...
 
 #endif
@@ -0,0 +1,58 @@
+// delete.c ... delete tuples from a relation
+// part of signature indexed files
+// Marks tuples matching a query as deleted (tombstones)
+// Their space is reclaimed by ./vacuum
+// Usage:  ./delete  [-v]  RelName  v1,v2,v3,v4,...  [t|p|b|h|r|a]
+
+#include "defs.h"
+#include "query.h"
+#include "tuple.h"
+#include "reln.h"
+
+#define USAGE "./delete  [-v]  RelName  v1,v2,v3,v4,...  [t|p|b|h|r|a]"
+
+// Main ... process args, delete tuples
+
+int main(int argc, char **argv)
+{
+	Reln r;       // open relation info
+	Query q;      // query iteration information
+	int verbose;  // show each deleted tuple
+	char *rname;  // name of table/file
+	char *qstr;   // query string
+	char  type = 'a';   // type of signatures to use
+	char err[MAXERRMSG];  // buffer for error messages
+
+	// process command-line args
+
+	if (argc < 3) fatal(USAGE, "");
+	if (strcmp(argv[1], "-v") == 0) {
+		verbose = 1;  argc--; argv++;
+	}
+	else
+		verbose = 0;
+	if (argc < 3) fatal(USAGE, "");
+	rname = argv[1];  qstr = argv[2];
+	if (argc > 3) type = argv[3][0];
+
+	// initialise relation and scan descriptors
+
+	if ((r = openRelation(rname)) == NULL) {
+		sprintf(err, "Can't open relation: %s",rname);
+		fatal("", err);
+	}
+	if ((q = startQuery(r, qstr, type)) == NULL) {
+		sprintf(err, "Invalid query: %s",qstr);
+		fatal("",err);
+	}
+
+	q->display = verbose;
+	BigCount n = deleteMatchingTuples(q);
+	printf("Deleted %llu tuples\n", n);
+
+	// clean up
+	closeQuery(q);
+	closeRelation(r);
+
+	return 0;
+}
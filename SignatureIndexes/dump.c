@@ -19,17 +19,18 @@ int main(int argc, char **argv)
 
 	if (argc < 2) fatal(USAGE, "");
 
-	if ((r = openRelation(argv[1])) == NULL) {
+	if ((r = openRelationSnapshot(argv[1])) == NULL) {
 		sprintf(err, "Can't open relation: %s",argv[1]);
 		fatal("", err);
 	}
 
 	// scan data pages, printing each tuple
 
-	Page p; Tuple t; int pid, i;
+	Page p; Tuple t; PageID pid; int i;
 	for (pid = 0; pid < nPages(r); pid++) {
 		p = getPage(dataFile(r), pid);
-		for (i = 0; i < pageNitems(p); i++) {
+		for (i = 0; i < visibleTuples(r, pid, p); i++) {
+			if (tupleIsDeleted(r, p, i)) continue;
 			t = getTupleFromPage(r, p, i);
 			showTuple(r, t);
 			free(t);
@@ -0,0 +1,199 @@
+// fsig.c ... functions on frame-sliced signatures (fsig's)
+// part of signature indexed files
+// A tuple's frame-sliced signature has one frame of fm bits per
+// attribute, holding the codeword for that attribute alone.
+// Frames are stored by position (pid*tupPP + slot, as for tsigs)
+// in groups of nattrs pages: page g*nattrs + f holds frame f for
+// positions g*fsigPP .. (g+1)*fsigPP-1.
+// A query reads only the pages of frames for attributes it binds,
+// and skips a frame page once no position on it can still match.
+
+#include <unistd.h>
+#include "defs.h"
+#include "reln.h"
+#include "query.h"
+#include "tuple.h"
+#include "fsig.h"
+#include "sig.h"
+
+#define framePage(REL,G,F) ((G)*nAttrs(REL) + (F))
+
+// add frame-sliced signatures to a relation and build them
+// from the tuples already in the data file
+
+void newFrameSigs(Reln r)
+{
+	RelnParams *rp = &(r->params);
+	rp->options |= FRAME_SIGS;
+	rp->fsigNpages = rp->nfsigs = 0;
+	openFrameSigs(r);
+	int ok = ftruncate(r->fsigf, 0);
+	assert(ok == 0);
+	for (PageID pid = 0; pid < nPages(r); pid++) {
+		Page p = getPage(dataFile(r), pid);
+		for (Count i = 0; i < pageNitems(p); i++) {
+			Tuple t = getTupleFromPage(r, p, i);
+			putFrameSigs(r, pid, i, tupleIsDeleted(r, p, i) ? NULL : t);
+			free(t);
+		}
+		free(p);
+	}
+}
+
+void openFrameSigs(Reln r)
+{
+	r->fsigf = openSigFile(r, "fsig", r->params.sigGen);
+}
+
+void closeFrameSigs(Reln r)
+{
+	if (r->fsigf >= 0) close(r->fsigf);
+	r->fsigf = -1;
+}
+
+// write the frames for tuple slot in data page pid
+// t == NULL gives empty frames (e.g. for slots freed by vacuum)
+
+void putFrameSigs(Reln r, PageID pid, Count slot, Tuple t)
+{
+	RelnParams *rp = &(r->params);
+	BigCount pos = pid * rp->tupPP + slot;
+	PageID g = pos / rp->fsigPP;
+	while (framePage(r, g, nAttrs(r)-1) >= rp->fsigNpages) {
+		Page p = getNewLastPage(&rp->fsigNpages, r->fsigf);
+		free(p);
+	}
+	char **vals = (t == NULL) ? NULL : tupleVals(r, t);
+	for (Count f = 0; f < nAttrs(r); f++) {
+		Bits fsig = (t == NULL) ? newBits(rp->fm) : frameSig(r, f, vals[f]);
+		Page p = getPage(r->fsigf, framePage(r, g, f));
+		putBits(p, pos % rp->fsigPP, fsig);
+		while (pageNitems(p) <= pos % rp->fsigPP)
+			addOneItem(p);
+		putPage(r->fsigf, framePage(r, g, f), p);
+		freeBits(fsig);
+	}
+	if (vals != NULL) freeVals(vals, nAttrs(r));
+	if (rp->nfsigs <= pos) rp->nfsigs = pos + 1;
+}
+
+// write the frames for n consecutive positions from pos, given
+// as nattrs frames for each position, one frame page at a time
+
+void putFrameRun(Reln r, BigCount pos, BigCount n, Byte *frames)
+{
+	RelnParams *rp = &(r->params);
+	if (n == 0) return;
+	PageID lastg = (pos + n - 1) / rp->fsigPP;
+	while (framePage(r, lastg, nAttrs(r)-1) >= rp->fsigNpages) {
+		Page p = getNewLastPage(&rp->fsigNpages, r->fsigf);
+		free(p);
+	}
+	for (Count f = 0; f < nAttrs(r); f++) {
+		for (BigCount k = 0; k < n; ) {
+			PageID g = (pos + k) / rp->fsigPP;
+			Page p = getPage(r->fsigf, framePage(r, g, f));
+			for (; k < n && (pos + k) / rp->fsigPP == g; k++) {
+				Count slot = (pos + k) % rp->fsigPP;
+				memcpy(addrInPage(p, slot, rp->fsigSize),
+				       frames + (k*nAttrs(r) + f)*rp->fsigSize, rp->fsigSize);
+				while (pageNitems(p) <= slot)
+					addOneItem(p);
+			}
+			putPage(r->fsigf, framePage(r, g, f), p);
+		}
+	}
+	if (rp->nfsigs < pos + n) rp->nfsigs = pos + n;
+}
+
+// find "matching" pages using frame-sliced signatures
+
+void findPagesUsingFrameSigs(Query q)
+{
+	assert(q != NULL);
+	Reln r = q->rel;
+	RelnParams *rp = &(r->params);
+	// per disjunct: query frames and surviving tsig positions
+	Count nq = q->ndisjuncts;
+	Bits *qsigs = malloc(nq * nAttrs(r) * sizeof(Bits));
+	Bits *match = malloc(nq * sizeof(Bits));
+	Bool *bound = malloc(nq * sizeof(Bool));
+	assert(qsigs != NULL && match != NULL && bound != NULL);
+	char *save = q->qstring;
+	for (Count d = 0; d < nq; d++) {
+		q->qstring = q->disjuncts[d];
+		char **vals = tupleVals(r, q->qstring);
+		bound[d] = FALSE;
+		for (Count f = 0; f < nAttrs(r); f++) {
+			Bits qsig = frameSig(r, f, vals[f]);
+			if (nBitsSet(qsig) == 0) {
+				freeBits(qsig);
+				qsig = NULL;
+			}
+			else
+				bound[d] = TRUE;
+			qsigs[d*nAttrs(r) + f] = qsig;
+		}
+		freeVals(vals, nAttrs(r));
+		match[d] = newBits(rp->nfsigs > 0 ? rp->nfsigs : 1);
+		setAllBits(match[d]);
+	}
+	q->qstring = save;
+
+	Bits fsig = newBits(rp->fm);
+	for (Count f = 0; f < nAttrs(r); f++) {
+		for (PageID g = 0; framePage(r, g, f) < rp->fsigNpages; g++) {
+			BigCount first = g * rp->fsigPP;
+			BigCount last = first + rp->fsigPP;
+			if (last > rp->nfsigs) last = rp->nfsigs;
+			// the frame page is needed if any disjunct bound on
+			// this attribute still has candidates in its range
+			Bool needed = FALSE;
+			for (Count d = 0; d < nq && !needed; d++) {
+				if (qsigs[d*nAttrs(r) + f] == NULL) continue;
+				for (BigCount pos = first; pos < last; pos++)
+					if (bitIsSet(match[d], pos)) { needed = TRUE; break; }
+			}
+			if (!needed) continue;
+
+			Page p = getPage(r->fsigf, framePage(r, g, f));
+			q->nsigpages++;
+			for (Count i = 0; i < pageNitems(p); i++) {
+				BigCount pos = first + i;
+				Bool read = FALSE;
+				for (Count d = 0; d < nq; d++) {
+					Bits qsig = qsigs[d*nAttrs(r) + f];
+					if (qsig == NULL || !bitIsSet(match[d], pos)) continue;
+					if (!read) {
+						getBits(p, i, fsig);
+						q->nsigs++;
+						read = TRUE;
+					}
+					if (!isSubset(qsig, fsig))
+						unsetBit(match[d], pos);
+				}
+			}
+			free(p);
+		}
+	}
+
+	unsetAllBits(q->pages);
+	for (Count d = 0; d < nq; d++) {
+		// a disjunct with no bound attributes matches every page
+		if (!bound[d])
+			setAllBits(q->pages);
+		else {
+			for (BigCount pos = 0; pos < rp->nfsigs; pos++) {
+				PageID dpid = pos / maxTupsPP(r);
+				if (bitIsSet(match[d], pos) && dpid < nPages(r))
+					setBit(q->pages, dpid);
+			}
+		}
+		for (Count f = 0; f < nAttrs(r); f++)
+			if (qsigs[d*nAttrs(r) + f] != NULL)
+				freeBits(qsigs[d*nAttrs(r) + f]);
+		freeBits(match[d]);
+	}
+	free(qsigs); free(match); free(bound);
+	freeBits(fsig);
+}
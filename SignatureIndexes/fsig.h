@@ -0,0 +1,20 @@
+// fsig.h ... interface to functions on frame-sliced signatures
+// part of signature indexed files
+// See fsig.c for details of the file layout
+
+#ifndef FSIG_H
+#define FSIG_H 1
+
+#include "defs.h"
+#include "query.h"
+#include "reln.h"
+#include "bits.h"
+
+void newFrameSigs(Reln);
+void openFrameSigs(Reln);
+void closeFrameSigs(Reln);
+void putFrameSigs(Reln, PageID, Count, Tuple);
+void putFrameRun(Reln, BigCount, BigCount, Byte *);
+void findPagesUsingFrameSigs(Query);
+
+#endif
@@ -2,32 +2,288 @@
 // part of superimposed codeword signature files
 // Generates a list of K random tuples with N attributes
 // Note: all tuples have the same structure:
-// 7-digits,20-alphas,10-alphanum,..., up to N attributes
-// Usage:  ./insert  [-v]  #attributes  #tuples
+// 7-digits,20-alphas,6-alphanum,..., up to N attributes
+// Usage:  ./gendata  [-j Nthreads]  [-b]  [-d Attr:Dist]...  #tuples  #attributes  [startID]  [seed]
+// where -j = generate with Nthreads threads (output is the same for any N)
+//       -b = write fixed-size binary records (for insert -b), not lines
+//       -d = draw values of attribute Attr (0..#attributes-1) from
+//            one of the following distributions over N distinct values
+//            uniform[:N]        each value equally likely
+//            zipf:s[:N]         value of rank k has probability ~ 1/k^s
+//            seq[:N]            0, 1, 2, ..., N-1, 0, 1, ... in tuple order
+//            clustered[:N[:W]]  follows tuple order (like a sorted column),
+//                               jittered by up to W values (default 10)
+// Defaults: attribute 0 is seq (IDs from startID), attribute 1 is a
+//   random word per tuple, attribute i > 1 is seq:(i+1)*83
+// N defaults to 10^7 for attribute 0, 1000 for attributes > 1, and
+//   to a random word per tuple for attribute 1
+// IDs are 7 digits, so they wrap around after 9999999
+// Tuples are generated in chunks of CHUNK; each chunk has its own
+//   random number generator, seeded from the seed and chunk number
 // Written by John Shepherd, March 2019
 
+#include <math.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
 #include "defs.h"
+#include "tuple.h"
 
-#define USAGE "./gendata  #tuples  #attributes  [startID]  [seed]"
+#define USAGE "./gendata  [-j Nthreads]  [-b]  [-d Attr:Dist]...  #tuples  #attributes  [startID]  [seed]"
 
-// Main ... process args, read/insert tuples
+#define CHUNK       65536  // tuples per chunk
+#define MAX_THREADS 64
+#define MAX_ATTRS   9
+#define MAX_IDS     10000000
+
+// distribution of the values of one attribute
+
+typedef enum { UNIFORM, ZIPF, SEQ, CLUSTERED } DistKind;
+
+typedef struct _Dist {
+	DistKind kind;
+	BigCount n;      // #distinct values (0 = random word per tuple)
+	double   s;      // zipf exponent
+	BigCount width;  // clustered: jitter
+	// zipf, by rejection-inversion (Hormann & Derflinger, 1996)
+	double   hx1, hn, sp;
+} Dist;
+
+// a chunk of generated tuples, handled by one thread
+
+typedef struct _Chunk {
+	BigCount first, n;  // tuples [first, first+n)
+	char    *buf;       // output for the chunk
+	size_t   len;
+} Chunk;
+
+static int      natts;             // number of attributes in each tuple
+static BigCount ntups;             // number of tuples
+static int      startID;           // starting ID
+static long     seed;              // random seed
+static Bool     binary;            // fixed-size records?
+static Count    tupsize;           // #bytes in each tuple
+static Dist     dists[MAX_ATTRS];  // distribution for each attribute
+
+// random numbers: a xorshift64* generator per chunk
+
+static uint64_t splitmix(uint64_t x)
+{
+	x += 0x9e3779b97f4a7c15ULL;
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+	return x ^ (x >> 31);
+}
+
+static uint64_t nextRand(uint64_t *st)
+{
+	uint64_t x = *st;
+	x ^= x >> 12; x ^= x << 25; x ^= x >> 27;
+	*st = x;
+	return x * 0x2545f4914f6cdd1dULL;
+}
+
+static double randUnit(uint64_t *st)
+{
+	return (nextRand(st) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// helpers for zipf sampling, accurate near 0
+
+static double log1pOverX(double x)
+{
+	return (fabs(x) > 1e-8) ? log1p(x) / x : 1.0 - x * (0.5 - x * (1.0/3.0 - 0.25*x));
+}
+
+static double expm1OverX(double x)
+{
+	return (fabs(x) > 1e-8) ? expm1(x) / x : 1.0 + x * 0.5 * (1.0 + x/3.0 * (1.0 + 0.25*x));
+}
+
+static double zipfH(Dist *d, double x) { return exp(-d->s * log(x)); }
+
+static double zipfHIntegral(Dist *d, double x)
+{
+	double logX = log(x);
+	return expm1OverX((1.0 - d->s) * logX) * logX;
+}
+
+static double zipfHIntegralInv(Dist *d, double x)
+{
+	double t = x * (1.0 - d->s);
+	if (t < -1.0) t = -1.0;
+	return exp(log1pOverX(t) * x);
+}
+
+static void initZipf(Dist *d)
+{
+	d->hx1 = zipfHIntegral(d, 1.5) - 1.0;
+	d->hn = zipfHIntegral(d, d->n + 0.5);
+	d->sp = 2.0 - zipfHIntegralInv(d, zipfHIntegral(d, 2.5) - zipfH(d, 2.0));
+}
+
+// rank 1..n, with rank 1 the most frequent
+
+static BigCount zipfRank(Dist *d, uint64_t *st)
+{
+	for (;;) {
+		double u = d->hn + randUnit(st) * (d->hx1 - d->hn);
+		double x = zipfHIntegralInv(d, u);
+		double k = floor(x + 0.5);
+		if (k < 1) k = 1;
+		else if (k > d->n) k = d->n;
+		if (k - x <= d->sp || u >= zipfHIntegral(d, k + 0.5) - zipfH(d, k))
+			return (BigCount)k;
+	}
+}
+
+// value number (0..n-1) of attribute a in tuple i
+
+static BigCount drawValue(Dist *d, BigCount i, uint64_t *st)
+{
+	switch (d->kind) {
+	case UNIFORM:
+		return nextRand(st) % d->n;
+	case ZIPF:
+		return zipfRank(d, st) - 1;
+	case SEQ:
+		return i % d->n;
+	case CLUSTERED:
+		return ((BigCount)((double)i / ntups * d->n) + nextRand(st) % d->width) % d->n;
+	}
+	return 0;
+}
+
+// word of nchars alphas: random, or determined by value number k
+
+static char alpha[52] = {
+	'a','b','c','d','e','f','g','h','i','j','k','l','m',
+	'n','o','p','q','r','s','t','u','v','w','x','y','z',
+	'A','B','C','D','E','F','G','H','I','J','K','L','M',
+	'N','O','P','Q','R','S','T','U','V','W','X','Y','Z',
+};
+
+static char *makeWord(char *buf, int nchars, uint64_t *st)
+{
+	int i;
+	for (i = 0; i < nchars; i++)
+		buf[i] = alpha[nextRand(st) % 52];
+	buf[i] = '\0';
+	return buf;
+}
+
+// generate the tuples of one chunk
+
+static void *genChunk(void *arg)
+{
+	Chunk *c = arg;
+	uint64_t st = splitmix(seed ^ splitmix(c->first / CHUNK));
+	if (st == 0) st = 1;
+	char *out = c->buf;
+	for (BigCount i = c->first; i < c->first + c->n; i++) {
+		char val[30];
+		for (int a = 0; a < natts; a++) {
+			Dist *d = &dists[a];
+			if (a > 0) *out++ = ',';
+			if (a == 1 && d->n == 0) {
+				out += sprintf(out, "%s", makeWord(val, 20, &st));
+				continue;
+			}
+			BigCount k = drawValue(d, i, &st);
+			if (a == 0)
+				out += sprintf(out, "%07llu", (startID + k) % MAX_IDS);
+			else if (a == 1) {
+				uint64_t wst = splitmix(k + 1);
+				out += sprintf(out, "%s", makeWord(val, 20, &wst));
+			}
+			else
+				out += sprintf(out, "a%d-%03llu", a+1, k % 1000);
+		}
+		if (!binary) *out++ = '\n';
+	}
+	c->len = out - c->buf;
+	return NULL;
+}
+
+// parse "Attr:Dist[:args]" for -d
+
+static Bool parseDist(char *spec)
+{
+	char name[20];
+	int a, n;
+	if (sscanf(spec, "%d:%19[a-z]%n", &a, name, &n) != 2) return FALSE;
+	if (a < 0 || a >= MAX_ATTRS) return FALSE;
+	Dist *d = &dists[a];
+	char *args = spec + n;
+	double x = 0, y = 0;
+	int nargs = 0;
+	if (*args == ':') nargs = sscanf(args, ":%lf:%lf", &x, &y);
+	else if (*args != '\0') return FALSE;
+	d->n = 0; d->width = 10;  // n = 0 for the default #values
+	if (strcmp(name, "uniform") == 0) {
+		d->kind = UNIFORM;
+		if (nargs > 0) d->n = x;
+	}
+	else if (strcmp(name, "zipf") == 0) {
+		d->kind = ZIPF;
+		if (nargs < 1 || x <= 0) return FALSE;
+		d->s = x;
+		if (nargs > 1) d->n = y;
+	}
+	else if (strcmp(name, "seq") == 0) {
+		d->kind = SEQ;
+		if (nargs > 0) d->n = x;
+	}
+	else if (strcmp(name, "clustered") == 0) {
+		d->kind = CLUSTERED;
+		if (nargs > 0) d->n = x;
+		if (nargs > 1) d->width = y;
+		if (d->width < 1) return FALSE;
+	}
+	else
+		return FALSE;
+	return TRUE;
+}
+
+// Main ... process args, generate tuples
 
 int main(int argc, char **argv)
 {
-	int  natts;	// number of attributes in each tuple
-	int  ntups;	// number of tuples
-	int  startID;  // starting ID
 	char err[100]; // buffer for error messages
-	char *randWord(char *buf, int nchars);
+	Bool given[MAX_ATTRS] = { FALSE };
 
 	// process command-line args
 
+	int nthreads = 1;
+	while (argc > 1 && argv[1][0] == '-') {
+		if (strcmp(argv[1], "-b") == 0)
+			binary = TRUE;
+		else if (strcmp(argv[1], "-j") == 0 && argc > 2) {
+			nthreads = atoi(argv[2]);
+			argc--; argv++;
+		}
+		else if (strcmp(argv[1], "-d") == 0 && argc > 2) {
+			if (!parseDist(argv[2])) {
+				sprintf(err, "Invalid distribution: %.60s", argv[2]);
+				fatal(USAGE, err);
+			}
+			given[atoi(argv[2])] = TRUE;
+			argc--; argv++;
+		}
+		else
+			fatal(USAGE, "");
+		argc--; argv++;
+	}
 	if (argc < 3) fatal(USAGE,"");
+	if (nthreads < 1 || nthreads > MAX_THREADS) {
+		sprintf(err, "Invalid #threads: %d (must be 1..%d)", nthreads, MAX_THREADS);
+		fatal("", err);
+	}
 
 	// how many tuples
-	ntups = atoi(argv[1]);
-	if (ntups < 1 || ntups > 100000) {
-		sprintf(err, "Invalid #tuples: %d (must be 0 < # < 10^6)", ntups);
+	ntups = strtoull(argv[1], NULL, 10);
+	if (ntups < 1) {
+		sprintf(err, "Invalid #tuples: %s (must be > 0)", argv[1]);
 		fatal("", err);
 	}
 
@@ -37,6 +293,7 @@ int main(int argc, char **argv)
 		sprintf(err, "Invalid #attrs: %d (must be 1 < # < 10)", natts);
 		fatal("", err);
 	}
+	tupsize = TEXT_TUPSIZE(natts);
 
 	// set starting ID
 	if (argc < 4)
@@ -50,42 +307,60 @@ int main(int argc, char **argv)
 	}
 
 	// seed random # generator
-	if (argc < 5)
-		srandom(0);
-	else
-		srandom(atoi(argv[4]));
+	seed = (argc < 5) ? 0 : atol(argv[4]);
 
-	// id ensures that all tuples are distinct
-	int i, j, id=startID;
-	for (i = 0; i < ntups; i++) {
-		char val[30];
-		printf("%07d,%s", id++, randWord(val, 20));
-		for (j = 0; j < natts-2; j++) {
-			int period = (j+3)*83;
-			printf(",a%d-%03d", j+3, (i%period));
+	// fill in distributions
+	for (int a = 0; a < MAX_ATTRS; a++) {
+		Dist *d = &dists[a];
+		if (given[a] && a >= natts) {
+			sprintf(err, "Invalid attribute in -d: %d (must be < #attrs)", a);
+			fatal("", err);
+		}
+		if (!given[a]) {
+			d->kind = (a == 1) ? UNIFORM : SEQ;
+			d->n = (a == 0) ? MAX_IDS : (a == 1) ? 0 : (a+1)*83;
 		}
-		putchar('\n');
+		else if (d->n == 0 && !(a == 1 && d->kind == UNIFORM))
+			d->n = (a == 0) ? MAX_IDS : 1000;
+		if ((a == 0 && d->n > MAX_IDS) || (a > 1 && d->n > 1000)) {
+			sprintf(err, "Too many values for attribute %d (max %d)",
+			        a, (a == 0) ? MAX_IDS : 1000);
+			fatal("", err);
+		}
+		if (d->kind == ZIPF) initZipf(d);
 	}
 
-	return OK;
-}
-
-// randWord: generate random sequence of Nchars alphas or alphanums
-// - store in supplied buffer, which hopefully is long enough
-
-char alpha[52] = {
-	'a','b','c','d','e','f','g','h','i','j','k','l','m',
-	'n','o','p','q','r','s','t','u','v','w','x','y','z',
-	'A','B','C','D','E','F','G','H','I','J','K','L','M',
-	'N','O','P','Q','R','S','T','U','V','W','X','Y','Z',
-};
+	if (binary) {
+		RecordHeader h = { RECORD_MAGIC, natts, tupsize };
+		fwrite(&h, sizeof(h), 1, stdout);
+	}
 
-char *randWord(char *buf, int nchars)
-{
-	int i;
-	for (i = 0; i < nchars; i++) {
-		buf[i] = alpha[rand()%52];
+	// generate nthreads chunks at a time, written in order
+	size_t maxlen = (size_t)CHUNK * (tupsize + 1);
+	Chunk chunks[MAX_THREADS];
+	pthread_t tids[MAX_THREADS];
+	for (int t = 0; t < nthreads; t++) {
+		chunks[t].buf = malloc(maxlen + 32);
+		assert(chunks[t].buf != NULL);
 	}
-	buf[i] = '\0';
-	return buf;
+	for (BigCount first = 0; first < ntups; ) {
+		int nc;
+		for (nc = 0; nc < nthreads && first < ntups; nc++) {
+			chunks[nc].first = first;
+			chunks[nc].n = (ntups - first < CHUNK) ? ntups - first : CHUNK;
+			first += chunks[nc].n;
+			if (nthreads > 1)
+				pthread_create(&tids[nc], NULL, genChunk, &chunks[nc]);
+			else
+				genChunk(&chunks[nc]);
+		}
+		for (int t = 0; t < nc; t++) {
+			if (nthreads > 1) pthread_join(tids[t], NULL);
+			fwrite(chunks[t].buf, 1, chunks[t].len, stdout);
+		}
+	}
+	for (int t = 0; t < nthreads; t++)
+		free(chunks[t].buf);
+
+	return OK;
 }
@@ -1,14 +1,19 @@
 // insert.c ... add tuples to a relation
 // part of signature indexed files
 // Reads tuples from stdin and inserts into Reln
-// Usage:  ./insert  [-v]  RelName
+// Usage:  ./insert  [-v]  [-b]  [-j Nthreads]  RelName
+// -b reads fixed-size tuple records (from gendata -b), not lines
+// -j computes signatures with Nthreads threads (default: #cpus),
+//    for a batch of BATCH_PAGES data pages at a time
 // Written by John Shepherd, March 2019
 
+#include <unistd.h>
 #include "defs.h"
 #include "reln.h"
 #include "tuple.h"
 
-#define USAGE "./insert  [-v]  RelName"
+#define USAGE "./insert  [-v]  [-b]  [-j Nthreads]  RelName"
+#define BATCH_PAGES 1024
 
 // Main ... process args, read/insert tuples
 
@@ -16,16 +21,32 @@ int main(int argc, char **argv)
 {
 	Reln r;  // handle on the open relation
 	char err[MAXERRMSG];  // buffer for error messages
-	int verbose;  // show extra info on query progress
+	int verbose = 0;  // show extra info on query progress
+	int binary = 0;   // read tuple records, not lines
 	char *rname;  // name of table/file
+	int nthreads = sysconf(_SC_NPROCESSORS_ONLN);
 
 	// process command-line args
 
+	while (argc > 1 && argv[1][0] == '-') {
+		if (strcmp(argv[1], "-v") == 0)
+			verbose = 1;
+		else if (strcmp(argv[1], "-b") == 0)
+			binary = 1;
+		else if (strcmp(argv[1], "-j") == 0 && argc > 2) {
+			nthreads = atoi(argv[2]);
+			argc--; argv++;
+		}
+		else
+			fatal(USAGE, "");
+		argc--; argv++;
+	}
 	if (argc < 2) fatal(USAGE, "");
-	if (strcmp(argv[1], "-v") == 0)
-		{ verbose = 1; rname = argv[2]; }
-	else
-		{ verbose = 0; rname = argv[1]; }
+	if (nthreads < 1) {
+		sprintf(err, "Invalid #threads: %d (must be >= 1)", nthreads);
+		fatal("", err);
+	}
+	rname = argv[1];
 
 
 	// set up relation for writing
@@ -37,16 +58,49 @@ int main(int argc, char **argv)
 
 	// read stdin and insert tuples
 
+	if (binary && !readRecordHeader(r, stdin)) {
+		sprintf(err, "Tuple records don't match relation %s", rname);
+		fatal("", err);
+	}
 	Tuple t;  PageID pid;
-	while ((t = readTuple(r,stdin)) != NULL) {
-		//printf("Inserting: "); showTuple(r,t);
-		pid = addToRelation(r,t);
-		if (pid == NO_PAGE) {
-			sprintf(err, "Insert of %s failed\n", t);
-			fatal("",err);
+	if (verbose) {
+		// one at a time, to show where each tuple goes
+		while ((t = binary ? readTupleRecord(r,stdin) : readTuple(r,stdin)) != NULL) {
+			if (!validTuple(r,t)) {
+				closeRelation(r);
+				sprintf(err, "Invalid tuple: %.*s", MAXERRMSG-20, t);
+				fatal("",err);
+			}
+			pid = addToRelation(r,t);
+			if (pid == NO_PAGE) {
+				sprintf(err, "Insert of %s failed\n", t);
+				fatal("",err);
+			}
+			printf("%s -> %llu\n",t,pid);
+			free(t);
+		}
+	}
+	Count max = BATCH_PAGES * maxTupsPP(r), n;
+	Tuple *batch = malloc(max * sizeof(Tuple));
+	Tuple bad = NULL;  // first invalid tuple read
+	assert(batch != NULL);
+	do {
+		for (n = 0; n < max; n++) {
+			t = binary ? readTupleRecord(r,stdin) : readTuple(r,stdin);
+			if (t == NULL) break;
+			if (!validTuple(r,t)) { bad = t; break; }
+			batch[n] = t;
 		}
-		if (verbose) printf("%s -> %d\n",t,pid);
-		free(t);
+		// the tuples before an invalid one are still inserted
+		if (n > 0 && addTuplesToRelation(r, batch, n, nthreads) == NO_PAGE)
+			fatal("", "Insert failed\n");
+		for (Count i = 0; i < n; i++) free(batch[i]);
+	} while (n == max);
+	free(batch);
+	if (bad != NULL) {
+		closeRelation(r);
+		sprintf(err, "Invalid tuple: %.*s", MAXERRMSG-20, bad);
+		fatal("",err);
 	}
 
 	// clean up
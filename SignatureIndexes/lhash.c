@@ -0,0 +1,318 @@
+// lhash.c ... linear hash index on attribute 0
+// part of signature indexed files
+// Maps hash(attribute 0) to the data pages holding that value
+//
+// Index entries are (hash, data PageID) pairs, one per distinct
+// (value, page) combination. Buckets are pages in the .hash file;
+// full buckets are extended by a chain of pages in the .hovf file.
+// Item 0 in every bucket/overflow page is not an entry: its pid
+// holds the PageID of the next overflow page (or NO_PAGE).
+//
+// Buckets are split in linear order (hsplit) whenever the index
+// exceeds HASH_LOAD of its primary capacity; an entry with hash h
+// lives in bucket h mod 2^hdepth, or h mod 2^(hdepth+1) if that
+// bucket has already been split.
+
+#include <unistd.h>
+#include <sys/file.h>
+#include "defs.h"
+#include "lhash.h"
+#include "reln.h"
+#include "query.h"
+#include "tuple.h"
+#include "page.h"
+#include "bits.h"
+#include "hash.h"
+
+#define HASH_LOAD 0.75
+
+typedef struct _HashEntry {
+        Word    hash;  // hash of attribute 0 value
+        PageID  pid;   // data page holding that value
+} HashEntry;
+
+static HashEntry *entryAt(Page p, Count i)
+{
+        return (HashEntry *)addrInPage(p, i, sizeof(HashEntry));
+}
+
+// create an empty bucket/overflow page
+
+static Page newBucket(Reln r)
+{
+        Page p = newPage(hashFile(r));
+        entryAt(p, 0)->pid = NO_PAGE;
+        addOneItem(p);
+        return p;
+}
+
+static PageID nextOvflow(Page p)
+{
+        return entryAt(p, 0)->pid;
+}
+
+static Word keyHash(Reln r, Tuple t)
+{
+        char **vals = tupleVals(r, t);
+        Word h = valueHash(r, 0, vals[0]);
+        freeVals(vals, nAttrs(r));
+        return h;
+}
+
+static PageID bucketOf(Reln r, Word h)
+{
+        RelnParams *rp = &(r->params);
+        PageID b = h & ((1u << rp->hdepth) - 1);
+        if (b < rp->hsplit)
+                b = h & ((1u << (rp->hdepth + 1)) - 1);
+        return b;
+}
+
+// add an entry to the end of a bucket chain
+// returns FALSE if an identical entry is already there
+
+static Bool addToChain(Reln r, PageID bucket, HashEntry *e, Bool check)
+{
+        Page p = getPage(hashFile(r), bucket);
+        File f = hashFile(r);
+        PageID pid = bucket;
+        for (;;) {
+                if (check) {
+                        for (Count i = 1; i < pageNitems(p); i++) {
+                                HashEntry *x = entryAt(p, i);
+                                if (x->hash == e->hash && x->pid == e->pid) {
+                                        free(p);
+                                        return FALSE;
+                                }
+                        }
+                }
+                if (nextOvflow(p) == NO_PAGE) break;
+                pid = nextOvflow(p);
+                free(p);
+                p = getPage(hovfFile(r), pid);
+                f = hovfFile(r);
+        }
+        if (pageNitems(p) > r->params.hentPP) {
+                // last page in chain is full; link in a new overflow page
+                PageID ovpid = r->params.hovfNpages;
+                Page ovp = getNewLastPage(&(r->params.hovfNpages), hovfFile(r));
+                free(ovp);
+                entryAt(p, 0)->pid = ovpid;
+                putPage(f, pid, p);
+                p = newBucket(r);
+                pid = ovpid;
+                f = hovfFile(r);
+        }
+        *entryAt(p, pageNitems(p)) = *e;
+        addOneItem(p);
+        putPage(f, pid, p);
+        return TRUE;
+}
+
+// split bucket hsplit, moving entries into new bucket hsplit+2^hdepth
+// the pages of the old chain are reused, in order, for its remaining entries
+
+static void splitBucket(Reln r)
+{
+        RelnParams *rp = &(r->params);
+        PageID old = rp->hsplit;
+        Word mask = (1u << (rp->hdepth + 1)) - 1;
+
+        // gather all entries from the old chain
+        Count nents = 0, maxents = 0;
+        HashEntry *ents = NULL;
+        PageID pid = old;
+        Page p = getPage(hashFile(r), pid);
+        for (;;) {
+                if (nents + pageNitems(p) > maxents) {
+                        maxents = 2*(nents + pageNitems(p));
+                        ents = realloc(ents, maxents*sizeof(HashEntry));
+                        assert(ents != NULL);
+                }
+                for (Count i = 1; i < pageNitems(p); i++)
+                        ents[nents++] = *entryAt(p, i);
+                PageID next = nextOvflow(p);
+                free(p);
+                if (next == NO_PAGE) break;
+                p = getPage(hovfFile(r), next);
+        }
+
+        // add new bucket at the end of the primary file
+        Page newp = getNewLastPage(&(rp->hashNpages), hashFile(r));
+        free(newp);
+        putPage(hashFile(r), rp->hashNpages-1, newBucket(r));
+        if (++rp->hsplit == (1u << rp->hdepth)) {
+                rp->hdepth++;
+                rp->hsplit = 0;
+        }
+
+        // rewrite old chain with its remaining entries, keeping links
+        File f = hashFile(r);
+        pid = old;
+        p = getPage(f, pid);
+        PageID next = nextOvflow(p);
+        free(p);
+        p = newBucket(r);
+        entryAt(p, 0)->pid = next;
+        for (Count i = 0; i < nents; i++) {
+                if ((ents[i].hash & mask) != old) continue;
+                if (pageNitems(p) > rp->hentPP) {
+                        putPage(f, pid, p);
+                        pid = next;
+                        f = hovfFile(r);
+                        p = getPage(f, pid);
+                        next = nextOvflow(p);
+                        free(p);
+                        p = newBucket(r);
+                        entryAt(p, 0)->pid = next;
+                }
+                *entryAt(p, pageNitems(p)) = ents[i];
+                addOneItem(p);
+        }
+        putPage(f, pid, p);
+        // empty any pages left at the end of the old chain
+        while (next != NO_PAGE) {
+                p = getPage(hovfFile(r), next);
+                PageID after = nextOvflow(p);
+                free(p);
+                p = newBucket(r);
+                entryAt(p, 0)->pid = after;
+                putPage(hovfFile(r), next, p);
+                next = after;
+        }
+
+        // move other entries into the new bucket
+        for (Count i = 0; i < nents; i++) {
+                if ((ents[i].hash & mask) == old) continue;
+                addToChain(r, ents[i].hash & mask, &ents[i], FALSE);
+        }
+        free(ents);
+}
+
+// open the index files of a relation that has a hash index
+
+void openHashIndex(Reln r)
+{
+        hashFile(r) = openRelnFile(r, "hash");
+        hovfFile(r) = openRelnFile(r, "hovf");
+}
+
+void closeHashIndex(Reln r)
+{
+        if (hashFile(r) >= 0) close(hashFile(r));
+        if (hovfFile(r) >= 0) close(hovfFile(r));
+        hashFile(r) = hovfFile(r) = -1;
+}
+
+// create a hash index for a relation
+// indexes any tuples already in the data file
+
+void newHashIndex(Reln r)
+{
+        RelnParams *rp = &(r->params);
+        assert(!hasOption(r, HASH_INDEX));
+        openHashIndex(r);
+        rp->options |= HASH_INDEX;
+        rp->hentPP = (pageSize(r) - sizeof(Count)) / sizeof(HashEntry) - 1;
+        rp->hdepth = rp->hsplit = 0;
+        rp->hashNpages = rp->hovfNpages = rp->nhentries = 0;
+        addPage(hashFile(r));
+        rp->hashNpages = 1;
+        putPage(hashFile(r), 0, newBucket(r));
+
+        for (PageID pid = 0; pid < nPages(r); pid++) {
+                Page p = getPage(dataFile(r), pid);
+                for (Count i = 0; i < pageNitems(p); i++) {
+                        if (tupleIsDeleted(r, p, i)) continue;
+                        Tuple t = getTupleFromPage(r, p, i);
+                        addToHashIndex(r, t, pid);
+                        free(t);
+                }
+                free(p);
+        }
+}
+
+// record that tuple t is stored in data page pid
+
+void addToHashIndex(Reln r, Tuple t, PageID pid)
+{
+        RelnParams *rp = &(r->params);
+        HashEntry e = { keyHash(r, t), pid };
+        if (!addToChain(r, bucketOf(r, e.hash), &e, TRUE))
+                return;
+        rp->nhentries++;
+        if (rp->nhentries > HASH_LOAD * rp->hashNpages * rp->hentPP)
+                splitBucket(r);
+}
+
+// remove the entry recording that tuple t's key is in data page pid
+
+void removeFromHashIndex(Reln r, Tuple t, PageID pid)
+{
+        Word h = keyHash(r, t);
+        PageID ppid = bucketOf(r, h);
+        File f = hashFile(r);
+        while (ppid != NO_PAGE) {
+                Page p = getPage(f, ppid);
+                for (Count i = 1; i < pageNitems(p); i++) {
+                        HashEntry *e = entryAt(p, i);
+                        if (e->hash != h || e->pid != pid) continue;
+                        // rewrite page without entry i
+                        Page newp = newBucket(r);
+                        entryAt(newp, 0)->pid = nextOvflow(p);
+                        for (Count j = 1; j < pageNitems(p); j++) {
+                                if (j == i) continue;
+                                *entryAt(newp, pageNitems(newp)) = *entryAt(p, j);
+                                addOneItem(newp);
+                        }
+                        free(p);
+                        putPage(f, ppid, newp);
+                        r->params.nhentries--;
+                        return;
+                }
+                ppid = nextOvflow(p);
+                f = hovfFile(r);
+                free(p);
+        }
+}
+
+// can the hash index answer this query?
+// i.e. relation has an index and query gives a value for attribute 0
+
+Bool hashIndexUsable(Query q)
+{
+        if (!hasOption(q->rel, HASH_INDEX)) return FALSE;
+        char **vals = tupleVals(q->rel, q->qstring);
+        Bool usable = !isUnknownVal(vals[0]) && !isRangeVal(vals[0]) && !isPatternVal(vals[0]);
+        freeVals(vals, nAttrs(q->rel));
+        return usable;
+}
+
+// find pages containing the query's attribute 0 value
+
+void findPagesUsingHashIndex(Query q)
+{
+        assert(q != NULL && hashIndexUsable(q));
+        Reln r = q->rel;
+        Word h = keyHash(r, q->qstring);
+        unsetAllBits(q->pages);
+
+        // buckets may be split meanwhile (see readIndexParams)
+        flock(hashFile(r), LOCK_SH);
+        readIndexParams(r);
+        Page p = getPage(hashFile(r), bucketOf(r, h));
+        for (;;) {
+                q->nsigpages++;
+                for (Count i = 1; i < pageNitems(p); i++) {
+                        HashEntry *e = entryAt(p, i);
+                        q->nsigs++;
+                        if (e->hash == h && e->pid < nPages(r))
+                                setBit(q->pages, e->pid);
+                }
+                PageID next = nextOvflow(p);
+                free(p);
+                if (next == NO_PAGE) break;
+                p = getPage(hovfFile(r), next);
+        }
+        flock(hashFile(r), LOCK_UN);
+}
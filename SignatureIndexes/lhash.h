@@ -0,0 +1,20 @@
+// lhash.h ... interface to the linear hash index
+// part of signature indexed files
+// See lhash.c for details of the index structure
+
+#ifndef LHASH_H
+#define LHASH_H 1
+
+#include "defs.h"
+#include "query.h"
+#include "reln.h"
+
+void newHashIndex(Reln);
+void openHashIndex(Reln);
+void closeHashIndex(Reln);
+void addToHashIndex(Reln, Tuple, PageID);
+void removeFromHashIndex(Reln, Tuple, PageID);
+Bool hashIndexUsable(Query);
+void findPagesUsingHashIndex(Query);
+
+#endif
@@ -0,0 +1,241 @@
+// match.c ... page-at-a-time tuple matching
+// part of signature indexed files
+// A Matcher holds a query's disjuncts, split into attribute values
+// once, and checks every tuple on a data page against them,
+// giving the same answers as tupleMatch without copying tuples.
+// The attribute boundaries of each tuple come from a scan for ','
+// that compares 32 (AVX2) or 16 (SSE2) bytes at a time, with a
+// byte-at-a-time fallback; build with -mavx2 to use AVX2, e.g.
+//   make CFLAGS="-std=gnu99 -Wall -Werror -g -mavx2"
+// Known values are then compared directly against the field bytes.
+// Typed relations need no scan: each attribute is at a fixed offset,
+// and integer attributes are compared as integers, against bounds
+// taken from the query value when the matcher is set up.
+
+#include <stdint.h>
+#include <limits.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include "defs.h"
+#include "match.h"
+#include "reln.h"
+#include "page.h"
+#include "tuple.h"
+#include "bits.h"
+
+#define MAX_MATCH_ATTRS 9  // = max #attrs
+#define SEP_WORDS       ((MAXTUPLEN+63)/64)
+
+// one attribute value of a disjunct
+
+typedef struct _AttrTest {
+	Bool   known;    // FALSE for "?" (matches anything)
+	char  *val;      // value as given
+	Count  len;
+	Bool   range;    // "lo..hi"?
+	char   lo[MAXTUPLEN], hi[MAXTUPLEN];
+	Bool   pattern;  // contains '*'?
+	long long ilo, ihi;  // integer attributes: the values that pass
+} AttrTest;
+
+struct _MatcherRep {
+	Reln      rel;
+	Count     ndisjuncts;
+	char   ***vals;   // attribute values of each disjunct
+	AttrTest *tests;  // ndisjuncts x nattrs
+	Count     offset[MAX_MATCH_ATTRS];  // of each attribute (typed tuples)
+};
+
+// the integers that pass test a: ilo .. ihi, empty if ilo > ihi
+// (numbers sort before other strings, so a range with a
+// non-numeric lower bound holds no numbers, and one with a
+// non-numeric upper bound has no upper limit; see compareVals)
+
+static void setIntBounds(AttrTest *a)
+{
+	a->ilo = LLONG_MIN;
+	a->ihi = LLONG_MAX;
+	if (a->range) {
+		if (a->lo[0] != '\0' && !isNumericVal(a->lo))
+			a->ilo = LLONG_MAX, a->ihi = LLONG_MIN;
+		else if (a->lo[0] != '\0')
+			a->ilo = strtoll(a->lo, NULL, 10);
+		if (a->hi[0] != '\0' && isNumericVal(a->hi))
+			a->ihi = strtoll(a->hi, NULL, 10);
+	}
+	else if (isNumericVal(a->val))
+		a->ilo = a->ihi = strtoll(a->val, NULL, 10);
+	else
+		a->ilo = LLONG_MAX, a->ihi = LLONG_MIN;
+}
+
+// set up a matcher for the OR of n plain queries
+
+Matcher newMatcher(Reln r, char **disjuncts, Count n)
+{
+	Matcher m = malloc(sizeof(struct _MatcherRep));
+	assert(m != NULL);
+	m->rel = r;
+	m->ndisjuncts = n;
+	m->vals = malloc(n * sizeof(char **));
+	m->tests = malloc(n * nAttrs(r) * sizeof(AttrTest));
+	assert(m->vals != NULL && m->tests != NULL);
+	for (Count d = 0; d < n; d++) {
+		m->vals[d] = tupleVals(r, disjuncts[d]);
+		for (Count i = 0; i < nAttrs(r); i++) {
+			AttrTest *a = &m->tests[d*nAttrs(r) + i];
+			a->val = m->vals[d][i];
+			a->len = strlen(a->val);
+			a->known = (a->val[0] != '?');
+			a->range = rangeBounds(a->val, a->lo, a->hi, MAXTUPLEN);
+			a->pattern = isPatternVal(a->val);
+			if (isIntAttr(r, i)) setIntBounds(a);
+		}
+	}
+	Count off = 0;
+	for (Count i = 0; hasOption(r, TYPED_TUPLES) && i < nAttrs(r); i++) {
+		m->offset[i] = off;
+		off += r->params.attrLen[i];
+	}
+	return m;
+}
+
+void freeMatcher(Matcher m)
+{
+	if (m == NULL) return;
+	for (Count d = 0; d < m->ndisjuncts; d++)
+		freeVals(m->vals[d], nAttrs(m->rel));
+	free(m->vals);
+	free(m->tests);
+	free(m);
+}
+
+// set bit j of seps for each ',' at byte j of a tuple
+
+static void findSeparators(Byte *t, Count size, uint64_t *seps)
+{
+	Count j = 0;
+	memset(seps, 0, SEP_WORDS * sizeof(uint64_t));
+#if defined(__AVX2__)
+	__m256i comma32 = _mm256_set1_epi8(',');
+	for (; j + 32 <= size; j += 32) {
+		__m256i v = _mm256_loadu_si256((__m256i *)(t + j));
+		uint32_t bits = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, comma32));
+		seps[j/64] |= (uint64_t)bits << (j%64);
+	}
+#endif
+#if defined(__AVX2__) || defined(__SSE2__)
+	__m128i comma16 = _mm_set1_epi8(',');
+	for (; j + 16 <= size; j += 16) {
+		__m128i v = _mm_loadu_si128((__m128i *)(t + j));
+		uint32_t bits = _mm_movemask_epi8(_mm_cmpeq_epi8(v, comma16));
+		seps[j/64] |= (uint64_t)bits << (j%64);
+	}
+#endif
+	for (; j < size; j++) {
+		if (t[j] == ',') seps[j/64] |= (uint64_t)1 << (j%64);
+	}
+}
+
+// does the field value (len bytes at f) pass test a? (see tupleMatch)
+
+static Bool fieldMatch(AttrTest *a, char *f, Count len)
+{
+	if (!a->known || (len > 0 && f[0] == '?')) return TRUE;
+	if (len == a->len && memcmp(f, a->val, len) == 0) return TRUE;
+	if (!a->range && !a->pattern) return FALSE;
+	char val[MAXTUPLEN+1];
+	memcpy(val, f, len);
+	val[len] = '\0';
+	if (a->range && (a->lo[0] == '\0' || compareVals(val, a->lo) >= 0)
+	             && (a->hi[0] == '\0' || compareVals(val, a->hi) <= 0))
+		return TRUE;
+	return a->pattern && matchPattern(val, a->val);
+}
+
+// does the integer field at f, of the given type, pass test a?
+
+static Bool intFieldMatch(AttrTest *a, char type, Byte *f)
+{
+	long long v;
+	if (!a->known || !intFieldValue(type, f, &v)) return TRUE;
+	if (v >= a->ilo && v <= a->ihi) return TRUE;
+	if (!a->pattern) return FALSE;
+	char val[32];
+	snprintf(val, sizeof(val), "%lld", v);
+	return matchPattern(val, a->val);
+}
+
+// set bit i of sel for each live tuple i on data page pid (in p)
+// that matches some disjunct, for a typed relation
+
+static Count matchTypedPage(Matcher m, PageID pid, Page p, Bits sel)
+{
+	Reln r = m->rel;
+	Count n = nAttrs(r), size = tupSize(r), nlive = 0;
+	unsetAllBits(sel);
+	for (Count i = 0; i < visibleTuples(r, pid, p); i++) {
+		if (tupleIsDeleted(r, p, i)) continue;
+		nlive++;
+		Byte *t = addrInPage(p, i, size);
+		Bool match = FALSE;
+		for (Count d = 0; !match && d < m->ndisjuncts; d++) {
+			AttrTest *a = &m->tests[d*n];
+			match = TRUE;
+			for (Count k = 0; match && k < n; k++) {
+				Byte *f = t + m->offset[k];
+				if (isIntAttr(r, k))
+					match = intFieldMatch(&a[k], attrType(r, k), f);
+				else
+					match = fieldMatch(&a[k], (char *)f,
+					                   strnlen((char *)f, r->params.attrLen[k]));
+			}
+		}
+		if (match) setBit(sel, i);
+	}
+	return nlive;
+}
+
+// set bit i of sel for each live tuple i on data page pid (in p)
+// that matches some disjunct; returns the number of live tuples checked
+
+Count matchPage(Matcher m, PageID pid, Page p, Bits sel)
+{
+	Reln r = m->rel;
+	if (hasOption(r, TYPED_TUPLES)) return matchTypedPage(m, pid, p, sel);
+	Count n = nAttrs(r), size = tupSize(r), nlive = 0;
+	uint64_t seps[SEP_WORDS];
+	Count start[MAX_MATCH_ATTRS], end[MAX_MATCH_ATTRS];
+	unsetAllBits(sel);
+	for (Count i = 0; i < visibleTuples(r, pid, p); i++) {
+		if (tupleIsDeleted(r, p, i)) continue;
+		nlive++;
+		char *t = (char *)addrInPage(p, i, size);
+		findSeparators((Byte *)t, size, seps);
+		// attribute boundaries; missing attributes are empty
+		Count f = 0;
+		start[0] = 0;
+		for (Count w = 0; w < SEP_WORDS && f < n-1; w++) {
+			for (uint64_t b = seps[w]; b != 0 && f < n-1; b &= b-1) {
+				Count j = w*64 + __builtin_ctzll(b);
+				end[f++] = j;
+				start[f] = j+1;
+			}
+		}
+		end[f] = size;
+		for (f++; f < n; f++) start[f] = end[f] = size;
+
+		Bool match = FALSE;
+		for (Count d = 0; !match && d < m->ndisjuncts; d++) {
+			AttrTest *a = &m->tests[d*n];
+			match = TRUE;
+			for (Count k = 0; match && k < n; k++)
+				match = fieldMatch(&a[k], t + start[k], end[k] - start[k]);
+		}
+		if (match) setBit(sel, i);
+	}
+	return nlive;
+}
@@ -0,0 +1,19 @@
+// match.h ... interface to page-at-a-time tuple matching
+// part of signature indexed files
+// See match.c for details of the matching kernel
+
+#ifndef MATCH_H
+#define MATCH_H 1
+
+typedef struct _MatcherRep *Matcher;
+
+#include "defs.h"
+#include "reln.h"
+#include "page.h"
+#include "bits.h"
+
+Matcher newMatcher(Reln, char **, Count);
+Count matchPage(Matcher, PageID, Page, Bits);
+void freeMatcher(Matcher);
+
+#endif
@@ -0,0 +1,72 @@
+// mkindex.c ... add an index to an existing relation
+// part of signature indexed files
+// Builds the index from the tuples already in the data file
+// Usage:  ./mkindex  RelName  hash
+//         ./mkindex  RelName  btree  AttrNo
+//         ./mkindex  RelName  frames
+//         ./mkindex  RelName  zones
+//         ./mkindex  RelName  tslices
+
+#include "defs.h"
+#include "reln.h"
+#include "lhash.h"
+#include "btree.h"
+#include "fsig.h"
+#include "zone.h"
+#include "tbsig.h"
+
+#define USAGE "./mkindex  RelName  hash|btree|frames|zones|tslices  [AttrNo]"
+
+// Main ... process args, build index
+
+int main(int argc, char **argv)
+{
+	Reln r;  // open relation info
+	char err[MAXERRMSG];  // buffer for error messages
+
+	// process command-line args
+
+	if (argc < 3) fatal(USAGE, "");
+	if (!existsRelation(argv[1]) || (r = openRelation(argv[1])) == NULL) {
+		sprintf(err, "Can't open relation: %s",argv[1]);
+		fatal("", err);
+	}
+
+	if (strcmp(argv[2], "hash") == 0) {
+		if (hasOption(r, HASH_INDEX))
+			fatal("", "Relation already has a hash index");
+		newHashIndex(r);
+	}
+	else if (strcmp(argv[2], "btree") == 0 && argc > 3) {
+		int attr = atoi(argv[3]);
+		if (attr < 0 || attr >= nAttrs(r)) {
+			sprintf(err, "Invalid attribute: %d (must be < %d)", attr, nAttrs(r));
+			fatal("", err);
+		}
+		if (hasOption(r, BTREE_INDEX))
+			fatal("", "Relation already has a B+-tree");
+		newBtreeIndex(r, attr);
+	}
+	else if (strcmp(argv[2], "frames") == 0) {
+		if (hasOption(r, FRAME_SIGS))
+			fatal("", "Relation already has frame-sliced signatures");
+		newFrameSigs(r);
+	}
+	else if (strcmp(argv[2], "zones") == 0) {
+		if (hasOption(r, ZONE_MAPS))
+			fatal("", "Relation already has zone maps");
+		newZoneMaps(r);
+	}
+	else if (strcmp(argv[2], "tslices") == 0) {
+		if (hasOption(r, TUPLE_SLICES))
+			fatal("", "Relation already has tuple bit-slices");
+		newTupleSlices(r);
+	}
+	else
+		fatal(USAGE, "");
+
+	// clean up
+
+	closeRelation(r);
+	return 0;
+}
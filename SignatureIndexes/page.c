@@ -4,6 +4,7 @@
 // Written by John Shepherd, March 2019
 
 #include <unistd.h>
+#include <sys/types.h>
 #include "defs.h"
 #include "page.h"
 #include "reln.h"
@@ -14,30 +15,54 @@ struct _PageRep {
 	Byte items[1]; // start of data
 };
 
-// A Page is a chunk of memory containing PAGESIZE bytes
+// A Page is a chunk of memory containing the page size of its file
 // It is implemented as a struct (nitems, items[])
 // - nitems is #items in page (all items are same size)
 // - items[] is a sequence of bytes containing items
 // - items can be tuples, tsigs, psigs or bsigs
 // - PageID values count # pages from start of file
 
-// create a new initially empty page in memory
-Page newPage()
+// size of pages in each open file, indexed by file descriptor
+// all files of a relation have the page size chosen when it was
+// created, and are given it as they are opened, so relations with
+// different page sizes can be open at once
+
+#define MAXFILES 1024
+
+static Count pageSizes[MAXFILES];
+
+void setPageSize(File f, Count size)
+{
+	assert(f >= 0 && f < MAXFILES);
+	assert(size >= MINPAGESIZE && size <= MAXPAGESIZE);
+	pageSizes[f] = size;
+}
+
+static Count filePageSize(File f)
+{
+	assert(f >= 0 && f < MAXFILES && pageSizes[f] > 0);
+	return pageSizes[f];
+}
+
+// create a new initially empty page in memory, for file f
+Page newPage(File f)
 {
-	Page p = malloc(PAGESIZE);
+	Count pageSize = filePageSize(f);
+	Page p = malloc(pageSize);
 	assert(p != NULL);
-	memset(p, 0, PAGESIZE);
+	memset(p, 0, pageSize);
 	return p;
 }
 
 // append a new Page to a file; return its PageID
 void addPage(File f)
 {
-	int ok = lseek(f, 0, SEEK_END);
-	assert(ok >= 0);
-	Page p = newPage();
-	int n = write(f, p, PAGESIZE);
-	assert(n == PAGESIZE);
+	off_t end = lseek(f, 0, SEEK_END);
+	assert(end >= 0);
+	Count pageSize = filePageSize(f);
+	Page p = newPage(f);
+	ssize_t n = write(f, p, pageSize);
+	assert(n == pageSize);
         free(p);
 }
 
@@ -48,12 +73,11 @@ Page getPage(File f, PageID pid)
 {
 	//fprintf(stderr,"getPage(%d)\n",pid);
 	assert(pid >= 0);
-	Page p = malloc(PAGESIZE);
+	Count pageSize = filePageSize(f);
+	Page p = malloc(pageSize);
 	assert(p != NULL);
-	int ok = lseek(f, pid*PAGESIZE, SEEK_SET);
-	assert(ok >= 0);
-	int n = read(f, p, PAGESIZE);
-	assert(n == PAGESIZE);
+	ssize_t n = pread(f, p, pageSize, (off_t)pid*pageSize);
+	assert(n == pageSize);
 	return p;
 }
 
@@ -63,10 +87,9 @@ Status putPage(File f, PageID pid, Page p)
 {
 	//fprintf(stderr, "putPage(%d)\n", pid);
 	assert(pid >= 0);
-	int ok = lseek(f, pid*PAGESIZE, SEEK_SET);
-	assert(ok >= 0);
-	int n = write(f, p, PAGESIZE);
-	assert(n == PAGESIZE);
+	Count pageSize = filePageSize(f);
+	ssize_t n = pwrite(f, p, pageSize, (off_t)pid*pageSize);
+	assert(n == pageSize);
 	free(p);
 	return 0;
 }
@@ -79,11 +102,11 @@ Byte *addrInPage(Page p, int off, int size)
 	return (Byte *)(&(p->items[0]) + size*off);
 }
 
-Page getNewLastPage(Count *npages, File f) {
+Page getNewLastPage(PageID *npages, File f) {
         Page p;
         addPage(f);
         *npages = *npages + 1;
-        p = newPage();
+        p = newPage(f);
         if (p == NULL) return NULL;
         return p;
 }
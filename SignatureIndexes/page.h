@@ -12,13 +12,14 @@ typedef struct _PageRep *Page;
 #include "reln.h"
 #include "tuple.h"
 
-Page newPage();
+void setPageSize(File, Count);
+Page newPage(File);
 void addPage(File);
 Page getPage(File, PageID);
 Status putPage(File, PageID, Page);
 Byte *addrInPage(Page, int, int);
 Count pageNitems(Page);
 void  addOneItem(Page);
-Page getNewLastPage(Count *npages, File f);
+Page getNewLastPage(PageID *npages, File f);
 
 #endif
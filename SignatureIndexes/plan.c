@@ -0,0 +1,494 @@
+// plan.c ... query cost estimation
+// part of signature indexed files
+// Estimates the page I/O of each access method from RelnParams
+// and the number of bits set in the query signature
+//
+// Cost model (all costs are page reads):
+// - a stored signature has each bit set with probability d,
+//   where d depends on the signature type, its width and how
+//   many tuples are superimposed in it (1 for tsigs, tupPP for psigs);
+//   for blkc, d is set so that d^qbits allows for the uneven blocks
+// - a non-matching signature passes the filter with prob d^qbits
+// - queries with some attribute known are assumed to have matches
+//   on one data page; queries with nothing known match every page
+// - zone maps (if the query uses them) are read in full; false
+//   matches fall in proportion to the pages they rule out
+
+#include <math.h>
+#include "defs.h"
+#include "plan.h"
+#include "query.h"
+#include "reln.h"
+#include "tuple.h"
+#include "bits.h"
+#include "tsig.h"
+#include "psig.h"
+#include "sig.h"
+#include "lhash.h"
+#include "btree.h"
+
+// #bits that one tuple's codewords set (before overlaps), and
+// how many codewords that takes (one per value and per trigram)
+
+static Count tupleCodeBits(Reln r, Count *ncodes)
+{
+        Count bits = 0;
+        *ncodes = 0;
+        for (Count i = 0; i < nAttrs(r); i++) {
+                Count ngrams = nGramsPerTuple(i+1, r->params.ngramAttrs & (1 << i));
+                bits += attrCodeBits(r, i) * (1 + ngrams);
+                *ncodes += 1 + ngrams;
+        }
+        return bits;
+}
+
+// blkc puts each codeword in one block, so blocks that happen to get
+// more codewords are denser than average and pass more queries than
+// the average density suggests; a query codeword passes with the
+// mean, over the number of codewords j in its block, of
+// (block density after j codewords)^k; returns the density d with
+// d^k equal to that, so that d^qbits still gives the pass rate
+
+static double blockDensity(Reln r, Count m, Count ntups)
+{
+        Count ncodes;
+        Count bits = tupleCodeBits(r, &ncodes);
+        if (ncodes == 0) return 0.0;
+        double nblocks = m / SIG_BLOCK;
+        double width = m / nblocks;  // last block takes the leftover bits
+        double k = (double)bits / ncodes;
+        double p = 1.0 / nblocks;
+        Count n = ncodes * ntups;   // codewords superimposed in the signature
+        double pass = 0.0;
+        for (Count j = 0; j <= n; j++) {
+                // probability that j of the n codewords fall in the block
+                double lpj = lgamma(n+1.0) - lgamma(j+1.0) - lgamma(n-j+1.0)
+                           + j*log(p) + (n-j)*log1p(-p);
+                double d = 1.0 - pow(1.0 - 1.0/width, k*j);
+                pass += exp(lpj) * pow(d, k);
+        }
+        return pow(pass, 1.0/k);
+}
+
+// probability that a bit is set in a signature of width m
+// formed by superimposing ntups tuples
+
+static double sigDensity(Reln r, Count m, Count ntups)
+{
+        double perTuple;  // fraction of bits set by one tuple
+        switch (sigType(r)) {
+        case 'c': {
+                // catc sets (w/2)/tupPP bits in each w-bit attribute region
+                Count start[MAXATTRS+1];
+                catcRegions(r, m, start);
+                Count b = 0;
+                for (Count i = 0; i < nAttrs(r); i++) {
+                        if (hasOption(r, ATTR_BITS) && r->params.attrBits[i] == 0) continue;
+                        b += ((start[i+1] - start[i]) / 2) / ntups;
+                }
+                perTuple = (m == 0) ? 1.0 : (double)b / m;
+                break;
+        }
+        case 'b':
+                if (m / SIG_BLOCK >= 2)
+                        return blockDensity(r, m, ntups);
+                // shorter blkc signatures get simc codewords
+                // fall through
+        case 's': {
+                Count ncodes;
+                Count bits = tupleCodeBits(r, &ncodes);
+                perTuple = 1.0 - pow(1.0 - 1.0/m, bits);
+                break;
+        }
+        default:
+                return 1.0;
+        }
+        return 1.0 - pow(1.0 - perTuple, ntups);
+}
+
+// probability that a data page with no matching tuples passes the
+// filter for a query signature with qbits bits set, via tsigs ('t')
+// or psigs ('p')
+
+static double pagePassRate(Reln r, char sigs, Count qbits)
+{
+        if (sigs == 'p')
+                return pow(sigDensity(r, psigBits(r), maxTupsPP(r)), qbits);
+        double pTuple = pow(sigDensity(r, tsigBits(r), 1), qbits);
+        return 1.0 - pow(1.0 - pTuple, maxTupsPP(r));
+}
+
+// how many attributes have a known value in the query
+
+static Count nKnownAttrs(Query q)
+{
+        char **vals = tupleVals(q->rel, q->qstring);
+        Count n = 0;
+        for (Count i = 0; i < nAttrs(q->rel); i++) {
+                if (!isUnknownVal(vals[i])) n++;
+        }
+        freeVals(vals, nAttrs(q->rel));
+        return n;
+}
+
+// fill in estimated candidate/false match pages, given
+// the probability that a non-matching data page passes the filter
+
+static void estimateDataPages(Query q, double pPage, QueryPlan *plan)
+{
+        double npages = nPages(q->rel);
+        double truePages = (nKnownAttrs(q) == 0) ? npages : fmin(1.0, npages);
+        plan->nfalse = (npages - truePages) * pPage;
+        plan->ntuppages = truePages + plan->nfalse;
+}
+
+// estimate costs of answering the current disjunct of query q
+
+static void estimateOne(Query q, char method, QueryPlan *plan)
+{
+        assert(q != NULL && plan != NULL);
+        Reln r = q->rel;
+        Bits qsig;
+
+        plan->method = method;
+        plan->qbits = 0;
+        plan->nsigpages = plan->nsigs = 0;
+        switch (method) {
+        case 't': {
+                qsig = makeTupleSig(r, q->qstring);
+                plan->qbits = nBitsSet(qsig);
+                freeBits(qsig);
+                plan->nsigpages = nTsigPages(r);
+                plan->nsigs = nTsigs(r);
+                estimateDataPages(q, pagePassRate(r, 't', plan->qbits), plan);
+                break;
+        }
+        case 'p':
+                qsig = makePageSig(r, q->qstring);
+                plan->qbits = nBitsSet(qsig);
+                freeBits(qsig);
+                plan->nsigpages = nPsigPages(r);
+                plan->nsigs = nPsigs(r);
+                estimateDataPages(q, pagePassRate(r, 'p', plan->qbits), plan);
+                break;
+        case 'b': {
+                qsig = makePageSig(r, q->qstring);
+                plan->qbits = nBitsSet(qsig);
+                // one slice per query bit, slices clustered on bsig pages
+                PageID lastpid = NO_PAGE;
+                for (Count i = 0; i < psigBits(r); i++) {
+                        if (!bitIsSet(qsig, i)) continue;
+                        if (i / maxBsigsPP(r) != lastpid) {
+                                lastpid = i / maxBsigsPP(r);
+                                plan->nsigpages++;
+                        }
+                }
+                freeBits(qsig);
+                plan->nsigs = plan->qbits;
+                estimateDataPages(q, pagePassRate(r, 'p', plan->qbits), plan);
+                break;
+        }
+        case 'T': {
+                // qbits slices in each group of positions in the slices,
+                // then the tsigs of the positions after them
+                RelnParams *rp = &(r->params);
+                qsig = makeTupleSig(r, q->qstring);
+                plan->qbits = nBitsSet(qsig);
+                freeBits(qsig);
+                double ngroups = (double)rp->tbsigSynced / (8.0*rp->tbsigSize);
+                double groupPages = ceil((double)tsigBits(r) / rp->tbsigPP);
+                plan->nsigpages = ngroups * fmin(plan->qbits, groupPages);
+                plan->nsigs = ngroups * plan->qbits;
+                double tail = fmax(0.0, (double)nTsigs(r) - rp->tbsigSynced);
+                plan->nsigpages += ceil(tail / maxTsigsPP(r));
+                plan->nsigs += tail;
+                estimateDataPages(q, pagePassRate(r, 't', plan->qbits), plan);
+                break;
+        }
+        case 'f': {
+                // one pass over the pages of each bound frame; later frames
+                // skip pages on which no position can still match
+                RelnParams *rp = &(r->params);
+                char **vals = tupleVals(r, q->qstring);
+                double ngroups = (double)rp->fsigNpages / nAttrs(r);
+                double fd = 1.0 - pow(1.0 - 1.0/rp->fm, codeBits(r));
+                double pTuple = 1.0;  // fraction of positions still matching
+                for (Count f = 0; f < nAttrs(r); f++) {
+                        qsig = frameSig(r, f, vals[f]);
+                        Count nbits = nBitsSet(qsig);
+                        freeBits(qsig);
+                        if (nbits == 0) continue;
+                        plan->qbits += nbits;
+                        double pGroup = 1.0 - pow(1.0 - pTuple, rp->fsigPP);
+                        plan->nsigpages += ngroups * pGroup;
+                        plan->nsigs += rp->nfsigs * pTuple;
+                        pTuple *= pow(fd, nbits);
+                }
+                freeVals(vals, nAttrs(r));
+                estimateDataPages(q, 1.0 - pow(1.0 - pTuple, maxTupsPP(r)), plan);
+                break;
+        }
+        case 'h':
+                // one bucket plus its share of overflow pages
+                plan->nsigpages = 1.0 + (double)r->params.hovfNpages / r->params.hashNpages;
+                plan->nsigs = (double)r->params.nhentries / r->params.hashNpages;
+                estimateDataPages(q, 0.0, plan);
+                break;
+        case 'r': {
+                // descend the tree, then scan the leaves holding the range
+                // data pages assume the attribute is clustered (e.g. IDs)
+                RelnParams *rp = &(r->params);
+                double sel = btreeSelectivity(q);
+                double nents = sel * rp->nbtentries;
+                plan->nsigpages = (rp->btDepth - 1) + fmax(1.0, nents / rp->btentPP);
+                plan->nsigs = nents;
+                plan->nfalse = 0;
+                plan->ntuppages = fmin(nPages(r), ceil(sel * nPages(r)));
+                break;
+        }
+        default:
+                // every page is read; those without matches are false matches
+                plan->method = '?';
+                estimateDataPages(q, 1.0, plan);
+                break;
+        }
+        plan->cost = plan->nsigpages + plan->ntuppages;
+}
+
+// estimate costs of answering query q using access method
+// signature methods read each signature once for all disjuncts,
+// while index lookups are repeated for each of them
+
+void estimatePlan(Query q, char method, QueryPlan *plan)
+{
+        assert(q != NULL && plan != NULL);
+        Reln r = q->rel;
+        char *save = q->qstring;
+        QueryPlan one;
+        for (Count d = 0; d < q->ndisjuncts; d++) {
+                q->qstring = q->disjuncts[d];
+                estimateOne(q, method, d == 0 ? plan : &one);
+                if (d == 0) continue;
+                if (one.qbits < plan->qbits) plan->qbits = one.qbits;
+                plan->ntuppages += one.ntuppages;
+                plan->nfalse += one.nfalse;
+                if (strchr("bhrT", plan->method) != NULL) {
+                        // bit-slices shared by disjuncts are capped below
+                        plan->nsigpages += one.nsigpages;
+                        plan->nsigs += one.nsigs;
+                }
+                else {
+                        plan->nsigpages = fmax(plan->nsigpages, one.nsigpages);
+                        plan->nsigs = fmax(plan->nsigs, one.nsigs);
+                }
+        }
+        q->qstring = save;
+        if (plan->method == 'T')
+                plan->nsigpages = fmin(plan->nsigpages,
+                                       r->params.tbsigNpages + nTsigPages(r));
+        if (plan->method == 'b') {
+                plan->nsigpages = fmin(plan->nsigpages, nBsigPages(r));
+                plan->nsigs = fmin(plan->nsigs, psigBits(r));
+                // deferred bit-slices are first synced from the psigs
+                if (r->params.bsigSynced < nPages(r)) {
+                        PageID behind = nPages(r) - r->params.bsigSynced;
+                        plan->nsigpages += 2*nBsigPages(r) + iceil(behind, maxPsigsPP(r));
+                }
+        }
+        plan->ntuppages = fmin(plan->ntuppages, nPages(r));
+        plan->nfalse = fmin(plan->nfalse, plan->ntuppages);
+        if (q->zone != NULL) {
+                double nzone = nBitsSet(q->zone);
+                double truePages = plan->ntuppages - plan->nfalse;
+                plan->nfalse *= nzone / fmax(1.0, nPages(r));
+                plan->ntuppages = fmin(truePages, nzone) + plan->nfalse;
+                plan->nsigpages += r->params.zoneNpages;
+        }
+        plan->cost = plan->nsigpages + plan->ntuppages;
+}
+
+// pick the access method with the lowest estimated page I/O
+
+char chooseAccessMethod(Query q)
+{
+        char methods[] = { '?', 't', 'p', 'b', 'f', 'h', 'r', 'T' };
+        QueryPlan plan;
+        char best = '?';
+        double bestCost = 0;
+        for (int i = 0; i < sizeof(methods); i++) {
+                if (methods[i] == 'f' && !hasOption(q->rel, FRAME_SIGS)) continue;
+                if (methods[i] == 'T' && !hasOption(q->rel, TUPLE_SLICES)) continue;
+                if (methods[i] == 'h' && !allDisjuncts(q, hashIndexUsable)) continue;
+                if (methods[i] == 'r' && !allDisjuncts(q, btreeIndexUsable)) continue;
+                estimatePlan(q, methods[i], &plan);
+                if (i == 0 || plan.cost < bestCost) {
+                        best = plan.method;
+                        bestCost = plan.cost;
+                }
+        }
+        return best;
+}
+
+// pick the cheapest signature method for filtering a set of
+// ncand candidate pages found via an index
+// returns '?' if no signature method is worth using
+
+char chooseSigMethod(Query q, double ncand)
+{
+        char methods[] = { 't', 'p', 'b', 'T' };
+        QueryPlan plan;
+        char best = '?';
+        double bestCost = ncand;
+        for (int i = 0; i < sizeof(methods); i++) {
+                if (methods[i] == 'T' && !hasOption(q->rel, TUPLE_SLICES)) continue;
+                estimatePlan(q, methods[i], &plan);
+                if (plan.qbits == 0) continue;
+                double cost = plan.nsigpages + fmin(plan.ntuppages, ncand);
+                if (cost < bestCost) {
+                        best = plan.method;
+                        bestCost = cost;
+                }
+        }
+        return best;
+}
+
+// chance that a data page with no matches is a candidate for query
+// q (for any of its disjuncts), with q's access method
+
+static double candidateRate(Query q)
+{
+        Reln r = q->rel;
+        char sigs;
+        if (strchr("tTf", q->method) != NULL) sigs = 't';
+        else if (strchr("pb", q->method) != NULL) sigs = 'p';
+        else return (q->method == '?') ? 1.0 : 0.0;  // indexes find just matches
+        double none = 1.0;
+        for (Count d = 0; d < q->ndisjuncts; d++) {
+                Bits qsig = (sigs == 't') ? makeTupleSig(r, q->disjuncts[d])
+                                          : makePageSig(r, q->disjuncts[d]);
+                none *= 1.0 - pagePassRate(r, sigs, nBitsSet(qsig));
+                freeBits(qsig);
+        }
+        return 1.0 - none;
+}
+
+// estimate how many tuples match query q, from its candidate pages
+// (q->pages, as found by its access method), reading just nsample
+// of them, chosen at random
+// - with no pages sampled, the candidates less the false matches
+//   expected of the signatures are taken as the matching pages,
+//   with one match each; the interval is for the number of false
+//   matches (binomial); if fewer than one false match is expected,
+//   some candidate is taken to match
+// - otherwise, the matches on the sampled pages are scaled up to
+//   all of the candidates; the interval is for the sample mean
+//   (normal, with one page taken as Poisson); if the sampled pages
+//   all hold the same number of matches (e.g. none), up to 3/k of
+//   the rest are taken to differ ("rule of three"), by as much as a
+//   page can
+// - sampling every candidate counts the matches exactly
+// signatures have no false drops, so no candidates means no matches
+// the data pages read are added to q's statistics
+
+void estimateMatches(Query q, Count nsample, MatchEstimate *e)
+{
+        Reln r = q->rel;
+        // count candidates among the real pages (page bitmaps can be longer)
+        double ncand = 0;
+        for (PageID pid = 0; pid < nPages(r); pid++)
+                if (bitIsSet(q->pages, pid)) ncand++;
+        e->candidates = ncand;
+        e->nsampled = 0;
+        e->nfalse = 0;
+        e->matches = e->lo = e->hi = 0;
+        e->exact = TRUE;
+        if (ncand == 0) return;
+        char *save = q->qstring;
+        for (Count d = 0; d < q->ndisjuncts; d++) {
+                q->qstring = q->disjuncts[d];
+                if (nKnownAttrs(q) > 0) continue;
+                // every tuple matches
+                q->qstring = save;
+                e->matches = e->lo = e->hi = nTuples(r);
+                return;
+        }
+        q->qstring = save;
+        e->exact = FALSE;
+
+        if (nsample == 0) {
+                double pass = candidateRate(q), npages = nPages(r);
+                if (pass >= 1.0) {
+                        e->matches = -1;
+                        e->hi = nTuples(r);
+                        return;
+                }
+                double ntrue = fmax(0.0, fmin(ncand, (ncand - npages*pass) / (1.0 - pass)));
+                double sd = sqrt((npages - ntrue) * pass * (1.0 - pass)) / (1.0 - pass);
+                e->nfalse = ncand - ntrue;
+                e->matches = ntrue;
+                e->lo = fmax(0.0, ntrue - 1.96*sd);
+                e->hi = fmin(ncand, ntrue + 1.96*sd);
+                if (npages*pass < 1.0 && e->matches < 1.0) {
+                        e->matches = 1.0;
+                        e->hi = fmax(e->hi, 1.0);
+                }
+                return;
+        }
+
+        // pick nsample of the candidates (a partial shuffle)
+        PageID *cand = malloc(ncand * sizeof(PageID));
+        assert(cand != NULL);
+        Count n = 0;
+        for (PageID pid = 0; pid < nPages(r); pid++)
+                if (bitIsSet(q->pages, pid)) cand[n++] = pid;
+        Count k = (nsample < n) ? nsample : n;
+        double sum = 0, sumsq = 0;
+        Count nfalse = 0;
+        Bits sel = newBits(maxTupsPP(r));
+        for (Count i = 0; i < k; i++) {
+                Count j = i + random() % (n - i);
+                PageID pid = cand[j];
+                cand[j] = cand[i];
+                Page p = getPage(dataFile(r), pid);
+                q->ntuppages++;
+                q->ntuples += matchPage(q->matcher, pid, p, sel);
+                double m = nBitsSet(sel);
+                free(p);
+                sum += m;
+                sumsq += m*m;
+                if (m == 0) nfalse++;
+        }
+        freeBits(sel);
+        free(cand);
+        q->nfalse += nfalse;
+        e->nsampled = k;
+        double mean = sum / k;
+        double var = (k > 1) ? fmax(0.0, (sumsq - k*mean*mean) / (k-1)) : mean;
+        double se = ncand * sqrt(var / k * (1.0 - k / ncand));
+        e->nfalse = ncand * nfalse / k;
+        e->matches = ncand * mean;
+        e->lo = fmax(sum, e->matches - 1.96*se);
+        e->hi = fmin(nTuples(r), e->matches + 1.96*se);
+        e->exact = (k == n);
+        if (var == 0 && k < n) {
+                double nodd = fmin(1.0, 3.0 / k) * (n - k);
+                e->lo = fmax(sum, e->matches - nodd * mean);
+                e->hi = fmin(nTuples(r), e->matches + nodd * (maxTupsPP(r) - mean));
+        }
+}
+
+// printable name of an access method
+
+char *accessMethodName(char method)
+{
+        switch (method) {
+        case 't': return "tsig";
+        case 'p': return "psig";
+        case 'b': return "bsig";
+        case 'f': return "fsig";
+        case 'h': return "hash";
+        case 'r': return "btree";
+        case 'T': return "tbsig";
+        default:  return "scan";
+        }
+}
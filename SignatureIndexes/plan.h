@@ -0,0 +1,42 @@
+// plan.h ... interface to query cost estimation
+// part of signature indexed files
+// See plan.c for details of the cost model
+
+#ifndef PLAN_H
+#define PLAN_H 1
+
+#include "defs.h"
+#include "query.h"
+#include "reln.h"
+
+// Estimated cost of answering a query via one access method
+
+typedef struct _QueryPlan {
+	char    method;     // 't', 'p', 'b', 'f', 'h', 'r', 'T' or '?' (full scan)
+	Count   qbits;      // #bits set in the query signature
+	double  nsigpages;  // estimated signature pages read
+	double  nsigs;      // estimated signatures read
+	double  ntuppages;  // estimated candidate data pages read
+	double  nfalse;     // estimated false match pages
+	double  cost;       // estimated total page reads
+} QueryPlan;
+
+// Estimated number of matching tuples, from the candidate pages
+// found by an access method (see estimateMatches)
+
+typedef struct _MatchEstimate {
+	BigCount candidates; // candidate data pages
+	double   nfalse;     // estimated false match pages among them
+	Count    nsampled;   // candidate pages read
+	double   matches;    // estimated matching tuples (< 0 if unknown)
+	double   lo, hi;     // 95% confidence interval
+	Bool     exact;      // matches counted, not estimated?
+} MatchEstimate;
+
+void estimatePlan(Query, char, QueryPlan *);
+void estimateMatches(Query, Count, MatchEstimate *);
+char chooseAccessMethod(Query);
+char chooseSigMethod(Query, double);
+char *accessMethodName(char);
+
+#endif
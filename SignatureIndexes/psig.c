@@ -19,6 +19,9 @@ Bits makePageSig(Reln r, Tuple t)
         case 's':
                 psig = simcSig(r, t, psigBits(r));
                 break;
+        case 'b':
+                psig = blkcSig(r, t, psigBits(r));
+                break;
         default:
                 psig = newBits(psigBits(r));
                 assert(psig != NULL);
@@ -31,25 +34,24 @@ Bits makePageSig(Reln r, Tuple t)
 void findPagesUsingPageSigs(Query q)
 {
 	assert(q != NULL);
-        Bits qsig = makePageSig(q->rel, q->qstring);
+        Bits *qsigs = querySigs(q, makePageSig);
         unsetAllBits(q->pages);
+        PageID pid = 0;
 
-        Bits psig = newBits(psigBits(q->rel));
-        assert(psig != NULL);
         for (PageID ppid = 0; ppid < nPsigPages(q->rel); ppid++) {
                 Page p = getPage(psigFile(q->rel), ppid);
                 q->nsigpages++;
 
                 for (Count i = 0; i < pageNitems(p); i++) {
-                        getBits(p, i, psig);
-                        if(isSubset(qsig, psig)) {
-                                setBit(q->pages, q->nsigs);
+                        Byte *psig = addrInPage(p, i, psigBytes(q->rel));
+                        if(pid < nPages(q->rel) && anyQuerySigMatches(q, qsigs, psig)) {
+                                setBit(q->pages, pid);
                         }
+                        pid++;
                         q->nsigs++;
                 }
                 free(p);
         }
-        freeBits(psig);
-        freeBits(qsig);
+        freeQuerySigs(q, qsigs);
 }
 
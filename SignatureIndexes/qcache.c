@@ -0,0 +1,241 @@
+// qcache.c ... persistent cache of query results
+// part of signature indexed files
+// R.qcache holds the results of recent queries (most recent first,
+// up to MAX_CACHED of them), each as
+//   CacheEntry, key (keylen bytes), nmatches positions (pid*tupPP + slot)
+// where the key is the query's disjuncts, sorted and joined by ';',
+// so that e.g. "{1|2},?" and "2,?;1,?" share an entry.
+// A result holds for the data pages there were when it was found;
+// as tuples are only appended, a repeat of the query reads just the
+// cached matches plus the pages appended since (and the last page
+// then, which may have gained tuples). Delete, update and vacuum
+// change tuples already stored, and bump the relation's epoch, which
+// makes all results from before them stale; a cached match deleted
+// since the relation was last published is skipped.
+// The file is replaced as a whole (via rename), so concurrent
+// readers each see some complete version of it.
+
+#include <unistd.h>
+#include <fcntl.h>
+#include "defs.h"
+#include "reln.h"
+#include "query.h"
+#include "qcache.h"
+
+#define MAX_CACHED 32  // queries
+
+typedef struct _CacheEntry {
+	Count    keylen;
+	Count    epoch;      // relation's epoch when found
+	PageID   npages;     // #data pages then
+	Count    lastNitems; // #tuples then on the last of them
+	BigCount nmatches;
+} CacheEntry;
+
+// the contents of R.qcache
+
+typedef struct _Cache {
+	Byte  *data;
+	size_t size;
+} Cache;
+
+// normalised form of a query (see above)
+
+static int compareStrings(const void *a, const void *b)
+{
+	return strcmp(*(char **)a, *(char **)b);
+}
+
+static char *cacheKey(Query q)
+{
+	char **ds = malloc(q->ndisjuncts * sizeof(char *));
+	assert(ds != NULL);
+	size_t len = 1;
+	for (Count d = 0; d < q->ndisjuncts; d++) {
+		ds[d] = q->disjuncts[d];
+		len += strlen(ds[d]) + 1;
+	}
+	qsort(ds, q->ndisjuncts, sizeof(char *), compareStrings);
+	char *key = malloc(len);
+	assert(key != NULL);
+	key[0] = '\0';
+	for (Count d = 0; d < q->ndisjuncts; d++) {
+		if (d > 0 && strcmp(ds[d], ds[d-1]) == 0) continue;
+		if (d > 0) strcat(key, ";");
+		strcat(key, ds[d]);
+	}
+	free(ds);
+	return key;
+}
+
+static void cacheFileName(Reln r, char *fname, int size)
+{
+	snprintf(fname, size, "%s.qcache", r->name);
+}
+
+static void readCache(Reln r, Cache *c)
+{
+	char fname[MAXFILENAME+8];
+	cacheFileName(r, fname, sizeof(fname));
+	c->data = NULL;
+	c->size = 0;
+	File f = open(fname, O_RDONLY);
+	if (f < 0) return;
+	off_t size = lseek(f, 0, SEEK_END);
+	c->data = malloc(size > 0 ? size : 1);
+	assert(c->data != NULL);
+	if (pread(f, c->data, size, 0) == size) c->size = size;
+	close(f);
+}
+
+// size of the entry at e (0 if it runs past the end of the cache)
+
+static size_t entrySize(Cache *c, Byte *e)
+{
+	CacheEntry h;
+	if (e + sizeof(h) > c->data + c->size) return 0;
+	memcpy(&h, e, sizeof(h));
+	size_t size = sizeof(h) + h.keylen + h.nmatches * sizeof(BigCount);
+	return (e + size > c->data + c->size) ? 0 : size;
+}
+
+// find the entry for key (NULL if there's none)
+
+static Byte *findEntry(Cache *c, char *key)
+{
+	size_t size;
+	for (Byte *e = c->data; (size = entrySize(c, e)) > 0; e += size) {
+		CacheEntry h;
+		memcpy(&h, e, sizeof(h));
+		if (h.keylen == strlen(key) && memcmp(e + sizeof(h), key, h.keylen) == 0)
+			return e;
+	}
+	return NULL;
+}
+
+// set up query qtext (as startQuery does) to use a cached result
+// the matches it still holds are in q->found (q->ncached of them),
+// and only the data pages after them are examined by the scan,
+// which adds the new matches to q->found
+// returns NULL if qtext is not a valid query
+
+Query startCachedQuery(Reln r, char *qtext, char sigs)
+{
+	Query q = newQuery(r, qtext);
+	if (q == NULL) return NULL;
+	q->record = TRUE;
+	char *key = cacheKey(q);
+	Cache c;
+	readCache(r, &c);
+	Byte *e = findEntry(&c, key);
+	CacheEntry h;
+	if (e != NULL) memcpy(&h, e, sizeof(h));
+	// a result from a newer snapshot than ours can't be used
+	if (e != NULL && h.epoch == r->params.epoch && h.npages > 0
+	    && (h.npages < nPages(r) || (h.npages == nPages(r)
+	                                 && h.lastNitems <= r->params.lastNitems))) {
+		if (h.npages == nPages(r) && h.lastNitems == r->params.lastNitems)
+			q->from = nPages(r);
+		else if (h.lastNitems == maxTupsPP(r))
+			q->from = h.npages;
+		else
+			q->from = h.npages - 1;
+		// matches are in position order; those from q->from on are found again
+		q->found = malloc((h.nmatches > 0 ? h.nmatches : 1) * sizeof(BigCount));
+		assert(q->found != NULL);
+		q->maxfound = h.nmatches > 0 ? h.nmatches : 1;
+		Byte *pos = e + sizeof(h) + h.keylen;
+		BigCount limit = q->from * maxTupsPP(r);
+		for (BigCount i = 0; i < h.nmatches; i++) {
+			BigCount p;
+			memcpy(&p, pos + i*sizeof(BigCount), sizeof(BigCount));
+			if (p >= limit) break;
+			q->found[q->nfound++] = p;
+		}
+		q->ncached = q->nfound;
+	}
+	free(c.data);
+	free(key);
+	findQueryPages(q, sigs);
+	return q;
+}
+
+// show the tuples of the cached matches of query q
+// (before the pages not covered by the cache are scanned)
+// matches deleted since are dropped from q->found
+
+void scanCachedMatches(Query q)
+{
+	Reln r = q->rel;
+	Page p = NULL;
+	PageID pid = NO_PAGE;
+	BigCount nlive = 0;
+	for (BigCount i = 0; i < q->ncached; i++) {
+		PageID mpid = q->found[i] / maxTupsPP(r);
+		Count slot = q->found[i] % maxTupsPP(r);
+		if (mpid != pid) {
+			free(p);
+			pid = mpid;
+			p = getPage(dataFile(r), pid);
+			q->ntuppages++;
+		}
+		if (tupleIsDeleted(r, p, slot)) continue;
+		q->found[nlive++] = q->found[i];
+		q->nmatches++;
+		if (q->display) {
+			Tuple t = getTupleFromPage(r, p, slot);
+			showTuple(r, t);
+			free(t);
+		}
+	}
+	free(p);
+	q->nfound = q->ncached = nlive;
+}
+
+// save the result of query q (cached and new matches in q->found)
+// as the most recent entry, dropping the least recent if needed
+
+void saveCachedResult(Query q)
+{
+	Reln r = q->rel;
+	char *key = cacheKey(q);
+	Cache c;
+	readCache(r, &c);
+
+	char fname[MAXFILENAME+8], tmpname[MAXFILENAME+32];
+	cacheFileName(r, fname, sizeof(fname));
+	snprintf(tmpname, sizeof(tmpname), "%s.tmp.%d", fname, (int)getpid());
+	File f = open(tmpname, O_WRONLY|O_CREAT|O_TRUNC, 0644);
+	assert(f >= 0);
+	CacheEntry h;
+	memset(&h, 0, sizeof(h));
+	h.keylen = strlen(key);
+	h.epoch = r->params.epoch;
+	h.npages = nPages(r);
+	h.lastNitems = r->params.lastNitems;
+	h.nmatches = q->nfound;
+	Bool ok = write(f, &h, sizeof(h)) == sizeof(h)
+	          && write(f, key, h.keylen) == h.keylen
+	          && write(f, q->found, h.nmatches*sizeof(BigCount)) == h.nmatches*sizeof(BigCount);
+
+	// then the other entries, still in order
+	Count n = 1;
+	size_t size;
+	for (Byte *e = c.data; ok && n < MAX_CACHED && (size = entrySize(&c, e)) > 0; e += size) {
+		CacheEntry old;
+		memcpy(&old, e, sizeof(old));
+		if (old.keylen == h.keylen && memcmp(e + sizeof(old), key, h.keylen) == 0)
+			continue;
+		if (old.epoch != r->params.epoch)
+			continue;  // stale
+		ok = write(f, e, size) == size;
+		n++;
+	}
+	close(f);
+	if (ok)
+		rename(tmpname, fname);
+	else
+		unlink(tmpname);
+	free(c.data);
+	free(key);
+}
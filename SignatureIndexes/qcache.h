@@ -0,0 +1,16 @@
+// qcache.h ... interface to the query result cache
+// part of signature indexed files
+// See qcache.c for details of the cache file
+
+#ifndef QCACHE_H
+#define QCACHE_H 1
+
+#include "defs.h"
+#include "reln.h"
+#include "query.h"
+
+Query startCachedQuery(Reln, char *, char);
+void  scanCachedMatches(Query);
+void  saveCachedResult(Query);
+
+#endif
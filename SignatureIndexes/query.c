@@ -11,6 +11,12 @@
 #include "tsig.h"
 #include "psig.h"
 #include "bsig.h"
+#include "fsig.h"
+#include "tbsig.h"
+#include "plan.h"
+#include "lhash.h"
+#include "btree.h"
+#include "zone.h"
 
 // check whether a query is valid for a relation
 // e.g. same number of attributes
@@ -25,29 +31,290 @@ int checkQuery(Reln r, char *q)
 	return (nattr == nAttrs(r));
 }
 
-// take a query string (e.g. "1234,?,abc,?")
+// expand a query into the plain queries (disjuncts) it is the OR of
+// disjuncts are separated by ';' and an attribute value may be a
+// list "{v1|v2|...}", which expands to one disjunct per value
+// e.g. "{1|2},?,x;3,?,?" gives "1,?,x", "2,?,x" and "3,?,?"
+// returns #disjuncts, or 0 if the query is invalid or expands
+// to more than MAXDISJUNCTS
+
+#define MAXDISJUNCTS 4096
+
+static Count expandDisjunct(Reln r, char *text, char **out, Count nout)
+{
+	// alternatives for each attribute value
+	char *alts[MAXTUPLEN];
+	Count nalts[MAXTUPLEN], nattrs = 0, total = 1;
+	char *c = text;
+	while (nattrs < MAXTUPLEN) {
+		Count n = 1;
+		alts[nattrs] = c;
+		if (*c == '{') {
+			alts[nattrs] = ++c;
+			while (*c != '}' && *c != '\0') {
+				if (*c == '|') { *c = '\0'; n++; }
+				c++;
+			}
+			if (*c != '}') return 0;
+			*c++ = '\0';
+			if (*c != ',' && *c != '\0') return 0;
+		}
+		else {
+			while (*c != ',' && *c != '\0') c++;
+		}
+		nalts[nattrs++] = n;
+		total *= n;
+		if (nout + total > MAXDISJUNCTS) return 0;
+		if (*c == '\0') break;
+		*c++ = '\0';
+	}
+	if (nattrs != nAttrs(r)) return 0;
+
+	// one disjunct for each combination of alternatives
+	for (Count k = 0; k < total; k++) {
+		char buf[MAXTUPLEN+1];
+		int len = 0;
+		Count rest = k;
+		for (Count i = 0; i < nattrs; i++) {
+			char *v = alts[i];
+			for (Count j = rest % nalts[i]; j > 0; j--)
+				v += strlen(v) + 1;
+			rest /= nalts[i];
+			len += snprintf(&buf[len], sizeof(buf)-len, "%s%s", (i == 0) ? "" : ",", v);
+			if (len >= sizeof(buf)) return 0;
+		}
+		out[nout + k] = strdup(buf);
+	}
+	return total;
+}
+
+static Count expandQuery(Reln r, char *text, char ***disjuncts)
+{
+	char *copy = strdup(text);
+	char **out = malloc(MAXDISJUNCTS * sizeof(char *));
+	assert(copy != NULL && out != NULL);
+	Count n = 0;
+	char *part = copy;
+	while (part != NULL) {
+		char *semi = strchr(part, ';');
+		if (semi != NULL) *semi = '\0';
+		Count k = (*part == '\0') ? 0 : expandDisjunct(r, part, out, n);
+		if (k == 0) {
+			for (Count i = 0; i < n; i++) free(out[i]);
+			n = 0;
+			break;
+		}
+		n += k;
+		part = (semi == NULL) ? NULL : semi+1;
+	}
+	free(copy);
+	*disjuncts = out;
+	return n;
+}
+
+// does test hold for every disjunct of the query?
+
+Bool allDisjuncts(Query q, Bool (*test)(Query))
+{
+	char *qstring = q->qstring;
+	Bool ok = TRUE;
+	for (Count d = 0; ok && d < q->ndisjuncts; d++) {
+		q->qstring = q->disjuncts[d];
+		ok = test(q);
+	}
+	q->qstring = qstring;
+	return ok;
+}
+
+// find pages via find for each disjunct and take the union
+
+static void findPagesForEach(Query q, void (*find)(Query))
+{
+	if (q->ndisjuncts == 1) {
+		find(q);
+		return;
+	}
+	char *qstring = q->qstring;
+	Bits found = newBits(nPages(q->rel));
+	for (Count d = 0; d < q->ndisjuncts; d++) {
+		q->qstring = q->disjuncts[d];
+		find(q);
+		orBits(found, q->pages);
+	}
+	q->qstring = qstring;
+	unsetAllBits(q->pages);
+	orBits(q->pages, found);
+	freeBits(found);
+}
+
+// one query signature per disjunct, made by makeSig
+
+Bits *querySigs(Query q, Bits (*makeSig)(Reln, Tuple))
+{
+	Bits *qsigs = malloc(q->ndisjuncts * sizeof(Bits));
+	assert(qsigs != NULL);
+	for (Count d = 0; d < q->ndisjuncts; d++)
+		qsigs[d] = makeSig(q->rel, q->disjuncts[d]);
+	return qsigs;
+}
+
+// could a stored signature (sig, in its page) match any disjunct?
+// it is checked in place, so only the parts of it under the
+// query signature's set bits are read
+
+Bool anyQuerySigMatches(Query q, Bits *qsigs, Byte *sig)
+{
+	for (Count d = 0; d < q->ndisjuncts; d++)
+		if (isSubsetOfBytes(qsigs[d], sig)) return TRUE;
+	return FALSE;
+}
+
+void freeQuerySigs(Query q, Bits *qsigs)
+{
+	for (Count d = 0; d < q->ndisjuncts; d++)
+		freeBits(qsigs[d]);
+	free(qsigs);
+}
+
+// narrow down the pages found via an index by using
+// signatures for the query's other attributes
+
+static void filterUsingSigs(Query q)
+{
+	char sigs = chooseSigMethod(q, nBitsSet(q->pages));
+	if (sigs == '?') return;
+	Bits found = newBits(nPages(q->rel));
+	orBits(found, q->pages);
+	switch (sigs) {
+	case 't': findPagesUsingTupSigs(q); break;
+	case 'p': findPagesUsingPageSigs(q); break;
+	case 'b': findPagesUsingBitSlices(q); break;
+	case 'T': findPagesUsingTupleSlices(q); break;
+	}
+	andBits(q->pages, found);
+	freeBits(found);
+}
+
+// take a query string (e.g. "1234,?,abc,?" or "{1234|1235},?,?,?")
 // set up a QueryRep object for the scan
+// all disjuncts are handled in one pass over the signatures
+// sigs 'a' picks the cheapest access method (see plan.c)
+// sigs 'h' uses the hash index, if it can answer the query
+// sigs 'r' uses the B+-tree for values/ranges ("lo..hi") on its attribute
+// sigs 'f' uses frame-sliced signatures, if the relation has them
+// sigs 'T' uses tuple bit-slices, if the relation has them
+// with zone maps, pages that can't hold numbers in the query's
+// ranges are dropped from those found by any method
 
 Query startQuery(Reln r, char *q, char sigs)
+{
+	Query new = newQuery(r, q);
+	if (new != NULL) findQueryPages(new, sigs);
+	return new;
+}
+
+// set up a QueryRep object for query string q, without
+// choosing the pages to examine (see findQueryPages)
+// returns NULL if q is not a valid query
+
+Query newQuery(Reln r, char *q)
 {
 	Query new = malloc(sizeof(QueryRep));
 	assert(new != NULL);
-	if (!checkQuery(r,q)) return NULL;
+	new->ndisjuncts = expandQuery(r, q, &new->disjuncts);
+	if (new->ndisjuncts == 0) {
+		free(new->disjuncts);
+		free(new);
+		return NULL;
+	}
 	new->rel = r;
-	new->qstring = q;
+	new->qtext = q;
+	new->qstring = new->disjuncts[0];
+	new->matcher = newMatcher(r, new->disjuncts, new->ndisjuncts);
 	new->nsigs = new->nsigpages = 0;
 	new->ntuples = new->ntuppages = new->nfalse = 0;
+	new->nmatches = new->ncached = new->nskipped = 0;
+	new->display = TRUE;
+	new->from = 0;
+	new->record = FALSE;
+	new->found = NULL;
+	new->nfound = new->maxfound = 0;
 	new->pages = newBits(nPages(r));
-	switch (sigs) {
-	case 't': findPagesUsingTupSigs(new); break;
-	case 'p': findPagesUsingPageSigs(new); break;
-	case 'b': findPagesUsingBitSlices(new); break;
-	default:  setAllBits(new->pages); break;
-	}
+	new->zone = NULL;
 	new->curpage = 0;
 	return new;
 }
 
+// pick q's access method from sigs (see startQuery)
+
+static void chooseMethod(Query q, char sigs)
+{
+	Reln r = q->rel;
+	if (sigs == 'h' && !allDisjuncts(q, hashIndexUsable)) sigs = 'a';
+	if (sigs == 'r' && !allDisjuncts(q, btreeIndexUsable)) sigs = 'a';
+	if (sigs == 'f' && !hasOption(r, FRAME_SIGS)) sigs = 'a';
+	if (sigs == 'T' && !hasOption(r, TUPLE_SLICES)) sigs = 'a';
+	q->autosel = (sigs == 'a');
+	if (q->autosel) sigs = chooseAccessMethod(q);
+	q->method = (strchr("tpbfhrT", sigs) != NULL) ? sigs : '?';
+	if (q->from > 0 && strchr("pbfT", q->method) != NULL)
+		q->method = 't';
+}
+
+// set up a QueryRep object for query string q, with the access
+// method that sigs asks for, but without reading any pages
+// (for showing the plan; with no zone maps, as none are read)
+// returns NULL if q is not a valid query
+
+Query planQuery(Reln r, char *q, char sigs)
+{
+	Query new = newQuery(r, q);
+	if (new != NULL) chooseMethod(new, sigs);
+	return new;
+}
+
+// find the pages to examine with access method sigs (see startQuery)
+// only data pages from q->from onwards are examined; signature
+// methods then just read the tsigs of those pages
+
+void findQueryPages(Query q, char sigs)
+{
+	Reln r = q->rel;
+	if (q->from >= nPages(r)) {
+		q->method = '?';  // no pages to examine
+		q->autosel = FALSE;
+		return;
+	}
+	q->zone = findPagesUsingZoneMaps(q);
+	chooseMethod(q, sigs);
+	switch (q->method) {
+	case 'h': findPagesForEach(q, findPagesUsingHashIndex); break;
+	case 'r': findPagesForEach(q, findPagesUsingBtree); filterUsingSigs(q); break;
+	case 't': findPagesUsingTupSigs(q); break;
+	case 'p': findPagesUsingPageSigs(q); break;
+	case 'b': findPagesUsingBitSlices(q); break;
+	case 'f': findPagesUsingFrameSigs(q); break;
+	case 'T': findPagesUsingTupleSlices(q); break;
+	default:  setAllBits(q->pages); break;
+	}
+	if (q->zone != NULL)
+		andBits(q->pages, q->zone);
+	for (PageID pid = 0; pid < q->from && pid < nPages(r); pid++)
+		unsetBit(q->pages, pid);
+}
+
+// keep the position of a matching tuple (see qcache.c)
+
+static void addFound(Query q, PageID pid, Count slot)
+{
+	if (q->nfound == q->maxfound) {
+		q->maxfound = (q->maxfound == 0) ? 1024 : 2*q->maxfound;
+		q->found = realloc(q->found, q->maxfound * sizeof(BigCount));
+		assert(q->found != NULL);
+	}
+	q->found[q->nfound++] = pid * maxTupsPP(q->rel) + slot;
+}
+
 // scan through selected pages (q->pages)
 // search for matching tuples and show each
 // accumulate query stats
@@ -56,6 +323,7 @@ void scanAndDisplayMatchingTuples(Query q)
 {
         //printf("k: %d\n m: %d\n", codeBits(q->rel), tsigBits(q->rel));
         Bits qpages = newBits(nPages(q->rel));
+        Bits sel = newBits(maxTupsPP(q->rel));
 
 	assert(q != NULL);
         for (q->curpage = 0; q->curpage < nPages(q->rel); q->curpage++) {
@@ -65,22 +333,19 @@ void scanAndDisplayMatchingTuples(Query q)
                 Count nMatch = 0;
                 Page p = getPage(dataFile(q->rel), q->curpage);
                 q->ntuppages++;
+                q->ntuples += matchPage(q->matcher, q->curpage, p, sel);
                 for (q->curtup = 0; q->curtup < pageNitems(p); q->curtup++) {
-                        Tuple t = getTupleFromPage(q->rel, p, q->curtup);
-                        q->ntuples++;
-                        if (tupleMatch(q->rel, t, q->qstring)) {
-                                setBit(qpages, q->curpage);
-                                /*
-                                printf("(p, op): (%d,%d)\t\t (tp, ot): (%d,%d)\t\t", 
-                                        q->curpage,
-                                        q->curtup,
-                                        (q->ntuples / maxTsigsPP(q->rel)), 
-                                        (q->ntuples % maxTsigsPP(q->rel)));*/
-
-                                nMatch++;
+                        if (!bitIsSet(sel, q->curtup)) continue;
+                        setBit(qpages, q->curpage);
+                        nMatch++;
+                        q->nmatches++;
+                        if (q->record)
+                                addFound(q, q->curpage, q->curtup);
+                        if (q->display) {
+                                Tuple t = getTupleFromPage(q->rel, p, q->curtup);
                                 showTuple(q->rel, t);
+                                free(t);
                         }
-                        free(t);
                 }
 
                 free(p);
@@ -90,19 +355,180 @@ void scanAndDisplayMatchingTuples(Query q)
 
         //showHexBits(qpages); printf("\n");
         free(qpages);
+        freeBits(sel);
+
+}
+
 
+// scan through selected pages (q->pages)
+// and mark all matching tuples as deleted
+// returns number of tuples deleted
+
+BigCount deleteMatchingTuples(Query q)
+{
+	assert(q != NULL);
+	Reln r = q->rel;
+	BigCount ndeleted = 0;
+	Bits sel = newBits(maxTupsPP(r));
+	for (q->curpage = 0; q->curpage < nPages(r); q->curpage++) {
+		if (!bitIsSet(q->pages, q->curpage)) continue;
+		Page p = getPage(dataFile(r), q->curpage);
+		q->ntuppages++;
+		Count nMatch = 0;
+		q->ntuples += matchPage(q->matcher, q->curpage, p, sel);
+		for (q->curtup = 0; q->curtup < pageNitems(p); q->curtup++) {
+			if (!bitIsSet(sel, q->curtup)) continue;
+			if (q->display) {
+				Tuple t = getTupleFromPage(r, p, q->curtup);
+				showTuple(r, t);
+				free(t);
+			}
+			markTupleDeleted(r, p, q->curtup);
+			nMatch++;
+		}
+		if (nMatch == 0) {
+			q->nfalse++;
+			free(p);
+			continue;
+		}
+		putPage(dataFile(r), q->curpage, p);
+		ndeleted += nMatch;
+	}
+	freeBits(sel);
+	q->nmatches = ndeleted;
+	if (ndeleted > 0) r->params.epoch++;  // cached results are stale
+	r->params.ntups -= ndeleted;
+	r->params.ndead += ndeleted;
+	return ndeleted;
 }
 
+// replace each matching tuple by a copy with the
+// non-"?" values from changes (e.g. "?,newname,?,?")
+// the new versions are inserted after the scan, so that
+// they are not themselves updated
+// matching tuples whose new version would not be a valid tuple
+// are left as they were, and counted in q->nskipped
+// sets *nupdated to the number of tuples updated
+// returns NOT_OK if changes are invalid
+
+Status updateMatchingTuples(Query q, char *changes, BigCount *nupdated)
+{
+	assert(q != NULL && nupdated != NULL);
+	Reln r = q->rel;
+	if (!checkQuery(r, changes)) return NOT_OK;
+	char **newvals = tupleVals(r, changes);
+
+	Count nnew = 0, maxnew = 64;
+	Tuple *newtups = malloc(maxnew * sizeof(Tuple));
+	assert(newtups != NULL);
+	Bits sel = newBits(maxTupsPP(r));
+	for (q->curpage = 0; q->curpage < nPages(r); q->curpage++) {
+		if (!bitIsSet(q->pages, q->curpage)) continue;
+		Page p = getPage(dataFile(r), q->curpage);
+		q->ntuppages++;
+		Count nMatch = 0;
+		q->ntuples += matchPage(q->matcher, q->curpage, p, sel);
+		for (q->curtup = 0; q->curtup < pageNitems(p); q->curtup++) {
+			if (!bitIsSet(sel, q->curtup)) continue;
+			Tuple t = getTupleFromPage(r, p, q->curtup);
+			// build new version of tuple
+			char **vals = tupleVals(r, t);
+			char newt[MAXTUPLEN];
+			int len = 0;
+			for (Count i = 0; i < nAttrs(r); i++) {
+				char *v = isUnknownVal(newvals[i]) ? vals[i] : newvals[i];
+				len += snprintf(&newt[len], MAXTUPLEN-len, "%s%s", (i == 0) ? "" : ",", v);
+				if (len >= MAXTUPLEN) break;
+			}
+			freeVals(vals, nAttrs(r));
+			if (len >= MAXTUPLEN || !validTuple(r, newt)) {
+				// new values must fit the tuple's size (or types)
+				q->nskipped++;
+				free(t);
+				continue;
+			}
+			if (q->display) showTuple(r, newt);
+			markTupleDeleted(r, p, q->curtup);
+			if (nnew == maxnew) {
+				maxnew *= 2;
+				newtups = realloc(newtups, maxnew * sizeof(Tuple));
+				assert(newtups != NULL);
+			}
+			newtups[nnew++] = strdup(newt);
+			nMatch++;
+			free(t);
+		}
+		if (nMatch == 0) {
+			q->nfalse++;
+			free(p);
+			continue;
+		}
+		putPage(dataFile(r), q->curpage, p);
+	}
+	freeBits(sel);
+	r->params.ntups -= nnew;
+	r->params.ndead += nnew;
+	for (Count i = 0; i < nnew; i++) {
+		addToRelation(r, newtups[i]);
+		free(newtups[i]);
+	}
+	free(newtups);
+	freeVals(newvals, nAttrs(r));
+	if (nnew > 0) r->params.epoch++;  // cached results are stale
+	q->nmatches = nnew;
+	*nupdated = nnew;
+	return OK;
+}
 
 // print statistics on query
 
 void queryStats(Query q)
 {
-	printf("# sig pages read:    %d\n", q->nsigpages);
-	printf("# signatures read:   %d\n", q->nsigs);
-	printf("# data pages read:   %d\n", q->ntuppages);
-	printf("# tuples examined:   %d\n", q->ntuples);
-	printf("# false match pages: %d\n", q->nfalse);
+	if (q->autosel)
+		printf("# access method:     %s (auto)\n", accessMethodName(q->method));
+	printf("# sig pages read:    %llu\n", q->nsigpages);
+	printf("# signatures read:   %llu\n", q->nsigs);
+	printf("# data pages read:   %llu\n", q->ntuppages);
+	printf("# tuples examined:   %llu\n", q->ntuples);
+	printf("# false match pages: %llu\n", q->nfalse);
+	if (q->ncached > 0)
+		printf("# cached matches:    %llu\n", q->ncached);
+}
+
+// show the estimated plan for a query (EXPLAIN)
+// with analyze, also show actual counts from a completed scan
+
+void explainQuery(Query q, Bool analyze)
+{
+	QueryPlan plan;
+	estimatePlan(q, q->method, &plan);
+	printf("Query Plan: %s\n", q->qtext);
+	if (q->ndisjuncts > 1)
+		printf("  disjuncts:         %d\n", q->ndisjuncts);
+	printf("  access method:     %s%s\n", accessMethodName(q->method),
+	       q->autosel ? " (auto)" : "");
+	printf("  query sig bits:    %d\n", plan.qbits);
+	printf("  design pF:         %g\n", q->rel->params.pF);
+	printf("  %-19s %12s", "", "estimated");
+	if (analyze) printf(" %10s", "actual");
+	putchar('\n');
+	printf("  %-19s %12.1f", "sig pages read:", plan.nsigpages);
+	if (analyze) printf(" %10llu", q->nsigpages);
+	putchar('\n');
+	printf("  %-19s %12.1f", "signatures read:", plan.nsigs);
+	if (analyze) printf(" %10llu", q->nsigs);
+	putchar('\n');
+	printf("  %-19s %12.1f", "candidate pages:", plan.ntuppages);
+	if (analyze) printf(" %10llu", q->ntuppages);
+	putchar('\n');
+	printf("  %-19s %12.1f", "false match pages:", plan.nfalse);
+	if (analyze) printf(" %10llu", q->nfalse);
+	putchar('\n');
+	printf("  %-19s %12.1f", "total pages read:", plan.cost);
+	if (analyze) printf(" %10llu", q->nsigpages + q->ntuppages);
+	putchar('\n');
+	if (analyze)
+		printf("  matching tuples:   %llu\n", q->nmatches);
 }
 
 // clean up a QueryRep object and associated data
@@ -110,6 +536,12 @@ void queryStats(Query q)
 void closeQuery(Query q)
 {
 	free(q->pages);
+	free(q->zone);
+	free(q->found);
+	freeMatcher(q->matcher);
+	for (Count d = 0; d < q->ndisjuncts; d++)
+		free(q->disjuncts[d]);
+	free(q->disjuncts);
 	free(q);
 }
 
@@ -9,30 +9,56 @@
 #include "reln.h"
 #include "tuple.h"
 #include "bits.h"
+#include "match.h"
 
 // A suggestion ... you can change however you like
 
 typedef struct _QueryRep {
 	// static info
 	Reln    rel;       // need to remember Relation info
-	char   *qstring;   // query string
+	char   *qtext;     // query as given, e.g. "{1|2},?,?;?,x,?"
+	char  **disjuncts; // plain queries that qtext is the OR of
+	Count   ndisjuncts;
+	char   *qstring;   // query string (the disjunct being processed)
+	Matcher matcher;   // checks the tuples on a page against qtext
+	char    method;    // access method used ('t','p','b','f','h','r','T','?')
+	Bool    autosel;   // was method chosen by cost estimates?
+	Bool    display;   // show matching tuples during scan?
 	//dynamic info
 	Bits    pages;     // list of pages to examine
+	Bits    zone;      // pages not ruled out by zone maps (or NULL)
 	PageID  curpage;   // current page in scan
 	Count   curtup;    // current tuple within page
+	PageID  from;      // data pages before this are not searched
+	Bool    record;    // keep the positions of matching tuples?
+	BigCount *found;   // positions (pid*tupPP + slot) of matches kept
+	BigCount nfound, maxfound;
 	// statistics info
-	Count   nsigs;     // how many signatures read
-	Count   nsigpages; // how many signature pages read
-	Count   ntuples;   // how many tuples examined
-	Count   ntuppages; // how many data pages read
-	Count   nfalse;    // how many pages had no matching tuples
+	BigCount nsigs;     // how many signatures read
+	BigCount nsigpages; // how many signature pages read
+	BigCount ntuples;   // how many tuples examined
+	BigCount ntuppages; // how many data pages read
+	BigCount nfalse;    // how many pages had no matching tuples
+	BigCount nmatches;  // how many tuples matched
+	BigCount ncached;   // how many matches came from the result cache
+	BigCount nskipped;  // how many matches were left as they were (update)
 } QueryRep;
 
 typedef struct _QueryRep *Query;
 
 Query startQuery(Reln, char *, char);
+Query newQuery(Reln, char *);
+Query planQuery(Reln, char *, char);
+void  findQueryPages(Query, char);
+Bool  allDisjuncts(Query, Bool (*)(Query));
+Bits *querySigs(Query, Bits (*)(Reln, Tuple));
+Bool  anyQuerySigMatches(Query, Bits *, Byte *);
+void  freeQuerySigs(Query, Bits *);
 void  scanAndDisplayMatchingTuples(Query);
+BigCount deleteMatchingTuples(Query);
+Status updateMatchingTuples(Query, char *, BigCount *);
 void  queryStats(Query);
+void  explainQuery(Query, Bool);
 void  closeQuery(Query);
 
 #endif
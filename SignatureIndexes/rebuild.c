@@ -0,0 +1,332 @@
+// rebuild.c ... rebuilding signature files with new parameters
+// part of signature indexed files
+// Reads the data file once, in batches of pages; worker threads
+// compute the tsigs and psigs for a batch using the new parameters,
+// then the main thread appends them to new signature files and
+// transposes the psigs into an in-memory bit-slice matrix, 64 data
+// pages at a time.
+// New files are named with the next signature generation (R.tsig.1,
+// R.psig.1, ...) and are swapped in by atomically replacing R.info,
+// after which the old generation is removed.
+// Frame-sliced signatures, if present, are rebuilt in the same pass.
+// Deleted tuples get empty tsigs and don't contribute to psigs.
+// Other writers wait until the rebuild is finished; readers keep
+// using the old generation until they reopen the relation.
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "defs.h"
+#include "rebuild.h"
+#include "reln.h"
+#include "page.h"
+#include "tuple.h"
+#include "bits.h"
+#include "tsig.h"
+#include "psig.h"
+#include "bsig.h"
+#include "tbsig.h"
+#include "sig.h"
+
+#define BATCH_PAGES 1024  // data pages per batch (multiple of 64)
+#define MAX_THREADS 64
+#define MAX_FRAMES  MAXATTRS
+
+// signatures for a batch of data pages
+
+typedef struct _Batch {
+	Reln   rel;     // relation descriptor with the new parameters
+	Page  *pages;   // data pages in the batch
+	Byte  *tsigs;   // tupPP tsigs for each data page
+	Byte  *psigs;   // one psig for each data page
+	Byte  *fsigs;   // nattrs frames for each tsig (or NULL)
+} Batch;
+
+// pages [from,to) of a batch, handled by one thread
+
+typedef struct _Work {
+	Batch *batch;
+	Count  from, to;
+} Work;
+
+// sequential writer of fixed-size signatures into a file
+
+typedef struct _SigWriter {
+	File   f;
+	Count  size;     // bytes per signature
+	Count  perPage;  // signatures per page
+	Count  nsigs;    // signatures written so far
+	Count  stride;   // file page = pid*stride + offset
+	Count  offset;   //   (frames are interleaved, see fsig.c)
+	PageID pid;      // page currently being filled
+	Page   page;
+} SigWriter;
+
+// write the nattrs frames for tuple t into buf
+
+static void makeFrames(Reln r, Tuple t, Byte *buf)
+{
+	RelnParams *rp = &(r->params);
+	char **vals = tupleVals(r, t);
+	for (Count f = 0; f < rp->nattrs; f++) {
+		Bits fsig = frameSig(r, f, vals[f]);
+		memcpy(buf + f*rp->fsigSize, bitsAddr(fsig), rp->fsigSize);
+		freeBits(fsig);
+	}
+	freeVals(vals, rp->nattrs);
+}
+
+// compute tsigs and psigs for one range of pages in a batch
+
+static void *makeBatchSigs(void *arg)
+{
+	Work *w = arg;
+	Batch *b = w->batch;
+	Reln r = b->rel;
+	RelnParams *rp = &(r->params);
+	for (Count i = w->from; i < w->to; i++) {
+		Page p = b->pages[i];
+		Byte *tsigs = b->tsigs + i*rp->tupPP*rp->tsigSize;
+		memset(tsigs, 0, rp->tupPP*rp->tsigSize);
+		if (b->fsigs != NULL)
+			memset(b->fsigs + i*rp->tupPP*rp->nattrs*rp->fsigSize, 0,
+			       rp->tupPP*rp->nattrs*rp->fsigSize);
+		Bits psig = newBits(rp->pm);
+		for (Count j = 0; j < pageNitems(p); j++) {
+			if (tupleIsDeleted(r, p, j)) continue;
+			Tuple t = getTupleFromPage(r, p, j);
+			Bits tsig = makeTupleSig(r, t);
+			memcpy(tsigs + j*rp->tsigSize, bitsAddr(tsig), rp->tsigSize);
+			freeBits(tsig);
+			if (b->fsigs != NULL)
+				makeFrames(r, t, b->fsigs + (i*rp->tupPP + j)*r->params.nattrs*rp->fsigSize);
+			Bits tpsig = makePageSig(r, t);
+			orBits(psig, tpsig);
+			freeBits(tpsig);
+			free(t);
+		}
+		memcpy(b->psigs + i*rp->psigSize, bitsAddr(psig), rp->psigSize);
+		freeBits(psig);
+	}
+	return NULL;
+}
+
+// compute the signatures of the n pages in batch b,
+// one range of pages per thread
+
+static void makeBatch(Batch *b, Count n, int nthreads)
+{
+	pthread_t tids[MAX_THREADS];
+	Work work[MAX_THREADS];
+	if (nthreads > MAX_THREADS) nthreads = MAX_THREADS;
+	Count per = iceil(n, nthreads);
+	int nw = 0;
+	for (Count from = 0; from < n; from += per, nw++) {
+		work[nw].batch = b;
+		work[nw].from = from;
+		work[nw].to = (from + per < n) ? from + per : n;
+		pthread_create(&tids[nw], NULL, makeBatchSigs, &work[nw]);
+	}
+	for (int i = 0; i < nw; i++)
+		pthread_join(tids[i], NULL);
+}
+
+// compute the tupPP tsigs and the psig of each of n data pages,
+// and their frames if fsigs != NULL, using nthreads threads
+// (used to insert many tuples at once; see addTuplesToRelation)
+
+void makePageSigs(Reln r, Page *pages, Count n,
+                  Byte *tsigs, Byte *psigs, Byte *fsigs, int nthreads)
+{
+	Batch b = { r, pages, tsigs, psigs, fsigs };
+	makeBatch(&b, n, nthreads < 1 ? 1 : nthreads);
+}
+
+// transpose the psigs of n (<= 64) consecutive data pages, starting
+// at page base (a multiple of 64), into the pm x bm slice matrix
+// each slice gets one 64-bit word, i.e. 8 bytes of its bit-string
+
+static void transposeBlock(RelnParams *rp, Byte *psigs, Count n,
+                           PageID base, Byte *slices)
+{
+	uint64_t *words = malloc(rp->pm * sizeof(uint64_t));
+	assert(words != NULL);
+	transposeSigs(psigs, n, rp->psigSize, words);
+	Count off = base / 8;
+	Count nbytes = rp->bsigSize - off < 8 ? rp->bsigSize - off : 8;
+	for (Count i = 0; i < rp->pm; i++) {
+		Byte *slice = slices + i*rp->bsigSize + off;
+		for (Count k = 0; k < nbytes; k++)
+			slice[k] = (Byte)(words[i] >> (8*k));
+	}
+	free(words);
+}
+
+static void startWriter(SigWriter *w, File f, Count size, Count perPage)
+{
+	w->f = f; w->size = size; w->perPage = perPage;
+	w->stride = 1; w->offset = 0;
+	w->nsigs = 0; w->pid = 0; w->page = newPage(f);
+}
+
+static void appendSig(SigWriter *w, Byte *sig)
+{
+	if (pageNitems(w->page) == w->perPage) {
+		putPage(w->f, w->pid*w->stride + w->offset, w->page);
+		w->pid++;
+		w->page = newPage(w->f);
+	}
+	memcpy(addrInPage(w->page, pageNitems(w->page), w->size), sig, w->size);
+	addOneItem(w->page);
+	w->nsigs++;
+}
+
+// write the last page; returns #pages written
+
+static PageID finishWriter(SigWriter *w)
+{
+	putPage(w->f, w->pid*w->stride + w->offset, w->page);
+	fsync(w->f);
+	return w->pid + 1;
+}
+
+// open a new, empty signature file
+
+static File newSigFile(Reln r, char *kind, Count gen)
+{
+	File f = openSigFile(r, kind, gen);
+	int ok = ftruncate(f, 0);
+	assert(ok == 0);
+	return f;
+}
+
+static void removeSigFiles(char *name, Count gen)
+{
+	char *kinds[] = { "tsig", "psig", "bsig", "fsig", "tbsig" };
+	char fname[MAXFILENAME+16];
+	for (int i = 0; i < 5; i++) {
+		sigFileName(fname, sizeof(fname), name, kinds[i], gen);
+		unlink(fname);
+	}
+}
+
+// rebuild the tsig, psig and bsig files of relation "name"
+// using new signature parameters, with nthreads worker threads
+// attrBits gives each attribute's codeword bits (see setAttrBits),
+// or is NULL for tk bits each
+// bm is raised to the current #data pages if needed
+// returns NOT_OK if the relation can't be opened or the new
+// signatures don't fit in pages
+
+Status rebuildSignatures(char *name, char sigtype, float pF, Count tk, Count tm,
+                         Count pm, Count bm, Count *attrBits, int nthreads)
+{
+	Reln r = openRelation(name);
+	if (r == NULL) return NOT_OK;
+	Status ok = rebuildRelationSigs(r, sigtype, pF, tk, tm, pm, bm, attrBits, nthreads);
+	closeRelation(r);
+	return ok;
+}
+
+// as rebuildSignatures, for relation r, open for writing
+// r is left open, using the new signature files
+
+Status rebuildRelationSigs(Reln r, char sigtype, float pF, Count tk, Count tm,
+                           Count pm, Count bm, Count *attrBits, int nthreads)
+{
+	char *name = r->name;
+	if (nthreads < 1) nthreads = 1;
+	if (nthreads > MAX_THREADS) nthreads = MAX_THREADS;
+
+	// relation descriptor holding the new parameters
+	RelnRep new = *r;
+	RelnParams *np = &(new.params);
+	if (bm < nPages(r)) bm = nPages(r);
+	if (setSigParams(np, sigtype, tk, tm, pm, bm) != OK)
+		return NOT_OK;
+	setAttrBits(np, attrBits);
+	np->pF = pF;
+	np->sigGen = r->params.sigGen + 1;
+	new.tsigf = newSigFile(r, "tsig", np->sigGen);
+	new.psigf = newSigFile(r, "psig", np->sigGen);
+	new.bsigf = newSigFile(r, "bsig", np->sigGen);
+	Bool framed = hasOption(r, FRAME_SIGS);
+	if (framed) new.fsigf = newSigFile(r, "fsig", np->sigGen);
+
+	SigWriter tw, pw, bw;
+	startWriter(&tw, new.tsigf, np->tsigSize, np->tsigPP);
+	startWriter(&pw, new.psigf, np->psigSize, np->psigPP);
+	SigWriter fw[MAX_FRAMES];
+	for (Count f = 0; framed && f < np->nattrs; f++) {
+		startWriter(&fw[f], new.fsigf, np->fsigSize, np->fsigPP);
+		fw[f].stride = np->nattrs; fw[f].offset = f;
+	}
+	Batch b;
+	b.rel = &new;
+	b.pages = malloc(BATCH_PAGES*sizeof(Page));
+	b.tsigs = malloc(BATCH_PAGES*np->tupPP*np->tsigSize);
+	b.psigs = malloc(BATCH_PAGES*np->psigSize);
+	b.fsigs = framed ? malloc(BATCH_PAGES*np->tupPP*np->nattrs*np->fsigSize) : NULL;
+	Byte *slices = calloc(np->pm, np->bsigSize);
+	assert(b.pages != NULL && b.tsigs != NULL && b.psigs != NULL && slices != NULL);
+
+	for (PageID first = 0; first < nPages(r); first += BATCH_PAGES) {
+		Count n = (nPages(r) - first < BATCH_PAGES) ? nPages(r) - first : BATCH_PAGES;
+		for (Count i = 0; i < n; i++)
+			b.pages[i] = getPage(dataFile(r), first+i);
+
+		makeBatch(&b, n, nthreads);
+
+		// tsigs are positional (pid*tupPP + slot), so all but the
+		// last data page get tupPP of them
+		for (Count i = 0; i < n; i++) {
+			PageID pid = first + i;
+			Count ntsigs = (pid == nPages(r)-1) ? pageNitems(b.pages[i]) : np->tupPP;
+			for (Count j = 0; j < ntsigs; j++) {
+				Count pos = i*np->tupPP + j;
+				appendSig(&tw, b.tsigs + pos*np->tsigSize);
+				for (Count f = 0; framed && f < np->nattrs; f++)
+					appendSig(&fw[f], b.fsigs + (pos*np->nattrs + f)*np->fsigSize);
+			}
+			appendSig(&pw, b.psigs + i*np->psigSize);
+			free(b.pages[i]);
+		}
+		for (Count i = 0; i < n; i += 64)
+			transposeBlock(np, b.psigs + i*np->psigSize,
+			               (n - i < 64) ? n - i : 64, first + i, slices);
+	}
+
+	startWriter(&bw, new.bsigf, np->bsigSize, np->bsigPP);
+	for (Count i = 0; i < np->pm; i++)
+		appendSig(&bw, slices + i*np->bsigSize);
+	np->tsigNpages = finishWriter(&tw); np->ntsigs = tw.nsigs;
+	np->psigNpages = finishWriter(&pw); np->npsigs = pw.nsigs;
+	np->bsigNpages = finishWriter(&bw); np->nbsigs = bw.nsigs;
+	np->bsigSynced = nPages(r);
+	if (framed) {
+		np->fsigNpages = 0;
+		for (Count f = 0; f < np->nattrs; f++)
+			np->fsigNpages += finishWriter(&fw[f]);
+		np->nfsigs = fw[0].nsigs;
+	}
+	free(b.pages); free(b.tsigs); free(b.psigs); free(b.fsigs); free(slices);
+
+	// swap in the new files; publishing .info makes them current
+	Count oldGen = r->params.sigGen;
+	lockForChange(r);
+	close(tsigFile(r)); close(psigFile(r)); close(bsigFile(r));
+	if (framed) close(fsigFile(r));
+	*r = new;
+	if (hasOption(r, TUPLE_SLICES)) {
+		// the tuple bit-slices are transposed from the new tsigs
+		close(r->tbsigf);
+		r->tbsigf = newSigFile(r, "tbsig", np->sigGen);
+		r->params.tbsigNpages = 0;
+		r->params.tbsigSynced = 0;
+		syncTupleSlices(r);
+	}
+	unlockForChange(r, TRUE);
+	removeSigFiles(name, oldGen);
+	return OK;
+}
@@ -0,0 +1,18 @@
+// rebuild.h ... interface to rebuilding signature files
+// part of signature indexed files
+// See rebuild.c for details of how signatures are rebuilt
+
+#ifndef REBUILD_H
+#define REBUILD_H 1
+
+#include "defs.h"
+#include "reln.h"
+
+Status rebuildSignatures(char *name, char sigtype, float pF, Count tk, Count tm,
+                         Count pm, Count bm, Count *attrBits, int nthreads);
+Status rebuildRelationSigs(Reln r, char sigtype, float pF, Count tk, Count tm,
+                           Count pm, Count bm, Count *attrBits, int nthreads);
+void makePageSigs(Reln r, Page *pages, Count n,
+                  Byte *tsigs, Byte *psigs, Byte *fsigs, int nthreads);
+
+#endif
@@ -0,0 +1,117 @@
+#!/bin/sh
+# regress.sh ... regression checks for signature indexed files
+# part of signature indexed files
+# Usage:  ./regress.sh  (or: make check)
+# Builds small relations in a scratch directory and checks the
+# behaviour of the tools on cases that have gone wrong before;
+# prints one line per check and exits non-zero if any failed
+
+BIN=$(cd "$(dirname "$0")" && pwd)
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+cd "$TMP" || exit 1
+
+nfail=0
+ok()   { echo "ok    $1"; }
+fail() { echo "FAIL  $1"; nfail=$((nfail+1)); }
+check() { if [ "$2" = "$3" ]; then ok "$1"; else fail "$1 (got '$2', expected '$3')"; fi; }
+
+# a relation R of 2000 tuples, 4 attributes
+$BIN/create R simc 2000 4 1000 || exit 1
+$BIN/gendata 2000 4 > R.txt 2>/dev/null
+$BIN/insert R < R.txt || exit 1
+
+# select -x only plans: it reads no signature or data pages
+cp R.info X.info; cp R.lock X.lock
+for f in data tsig psig bsig; do : > X.$f; done
+out=$($BIN/select -x X "1000005,?,?,?" a 2>&1)
+check "select -x reads no pages" "$?" "0"
+
+# a .info from a later version is refused, not misread
+cp R.info V.info; cp R.lock V.lock; cp R.data V.data
+printf '\377\000\000\000' | dd of=V.info bs=1 seek=4 conv=notrunc 2>/dev/null
+$BIN/stats V >/dev/null 2>&1
+check "unknown .info version refused" "$?" "1"
+
+# update: new values too long for the tuple are skipped (and
+# reported), however long they are; others are updated
+$BIN/create U simc 500 4 1000 >/dev/null || exit 1
+head -500 R.txt | $BIN/insert U || exit 1
+long=$(printf '%0300d' 0)
+out=$($BIN/update U "1000007,?,?,?" "?,$long,?,?" 2>&1)
+check "update with oversized value" "$? $out" "1 Updated 0 tuples
+Skipped 1 tuples whose new values don't fit"
+check "oversized update leaves tuple" "$($BIN/select U "1000007,?,?,?" | grep -c ,)" "1"
+$BIN/update U "1000007,?,?,?" "?,?,a3-x07,?" >/dev/null
+check "update with fitting value" "$($BIN/select U "?,?,a3-x07,?" | grep -c ^1000007,)" "1"
+
+# vacuum releases the pages it empties
+$BIN/delete U "?,?,?,?" >/dev/null
+head -10 R.txt | $BIN/insert U
+$BIN/vacuum U >/dev/null
+check "vacuum releases empty pages" "$($BIN/stats U | grep '#pages:  tuples: 1 ' | wc -l) $(stat -c %s U.data)" "1 4096"
+check "select after vacuum" "$($BIN/select U "?,?,?,?" b | grep -c ,)" "10"
+
+# insert: a short tuple ends the load with an error; the tuples
+# before it are inserted
+$BIN/create S simc 500 4 1000 >/dev/null || exit 1
+{ head -300 R.txt; echo "1,2,3,4"; sed -n 301,400p R.txt; } > S.txt
+$BIN/insert S < S.txt 2>/dev/null
+check "insert of short tuple fails" "$?" "1"
+check "tuples before short tuple" "$($BIN/select S "?,?,?,?" t | grep -c ,)" "300"
+
+# likewise a tuple with the wrong number of fields (of the right length)
+$BIN/create F simc 500 4 1000 >/dev/null || exit 1
+{ head -100 R.txt; sed -n 101p R.txt | sed 's/,/x/'; sed -n 102,300p R.txt; } > F.txt
+$BIN/insert F < F.txt 2>/dev/null
+check "insert of tuple with 3 fields fails" "$?" "1"
+check "tuples before 3-field tuple" "$($BIN/select F "?,?,?,?" t | grep -c ,)" "100"
+
+# and a typed tuple whose value doesn't fit its attribute's type
+$BIN/create -s "int32,char(20),char(6),char(6)" Y simc 500 4 1000 >/dev/null || exit 1
+{ head -100 R.txt; echo "abc,xx,yy,zz"; sed -n 101,300p R.txt; } > Y.txt
+$BIN/insert Y < Y.txt 2>/dev/null
+check "insert of ill-typed tuple fails" "$?" "1"
+check "tuples before ill-typed tuple" "$($BIN/select Y "?,?,?,?" t | grep -c ,)" "100"
+
+# select -c: results cached before an update are not reused
+$BIN/create C simc 500 4 1000 >/dev/null || exit 1
+head -400 R.txt | $BIN/insert C || exit 1
+$BIN/select -c C "?,?,a3-01*,?" >/dev/null
+$BIN/update C "?,?,a3-012,?" "?,?,a3-x12,?" >/dev/null
+check "select -c after update" "$($BIN/select -c C "?,?,a3-01*,?" | grep -c ,)" "18"
+check "select -c sees new version" "$($BIN/select -c C "?,?,a3-x12,?" | grep -c ,)" "2"
+$BIN/select -c C "?,?,a3-01*,?" >/dev/null
+check "select -c repeated" "$($BIN/select -c C "?,?,a3-01*,?" | grep -c ,)" "18"
+
+# select -e: sampling every candidate counts the matches exactly;
+# a smaller sample gives an interval holding the actual count
+for q in "?,?,a3-01*,?" "?,?,?,a4-00*"; do
+	actual=$($BIN/select R "$q" | grep -c ,)
+	check "estimate $q, all sampled" "$($BIN/select -e -s 1000 R "$q" | head -1)" \
+	      "Estimated matches: $actual (exact)"
+	for k in 3 10; do
+		est=$($BIN/select -e -s $k R "$q" | head -1)
+		lo=$(echo "$est" | sed -n 's/.*interval \([0-9]*\) .. \([0-9]*\))/\1/p')
+		hi=$(echo "$est" | sed -n 's/.*interval \([0-9]*\) .. \([0-9]*\))/\2/p')
+		if [ -n "$lo" ] && [ "$lo" -le "$actual" ] && [ "$actual" -le "$hi" ]; then
+			ok "estimate $q, $k sampled"
+		else
+			fail "estimate $q, $k sampled (got '$est', actual $actual)"
+		fi
+	done
+done
+
+# a reader with the relation open doesn't hold up inserts into
+# its indexes (flock stands in for a long select)
+$BIN/create -h -b 1 H simc 2000 4 1000 >/dev/null || exit 1
+head -1000 R.txt | $BIN/insert H || exit 1
+flock -s H.lock sleep 30 & reader=$!
+sleep 1
+sed -n 1001,2000p R.txt | timeout 10 $BIN/insert H
+check "insert with index beside a reader" "$?" "0"
+kill $reader 2>/dev/null; wait $reader 2>/dev/null
+check "hash lookup after insert" "$($BIN/select H "1001500,?,?,?" h | grep -c ,)" "1"
+
+echo "$nfail failed"
+[ $nfail -eq 0 ]
@@ -0,0 +1,80 @@
+// reindex.c ... rebuild signatures with new parameters
+// part of signature indexed files
+// Recomputes tk, tm, pm and bm from a new signature type, pF and
+// expected #tuples (as create does), then rebuilds the tsig, psig
+// and bsig files from the data file using several threads
+// (every attribute gets tk bits again; see tune for uneven ones)
+// Usage:  ./reindex  [-j Nthreads]  RelName  SigType  1/pF  [#tuples]
+// where #tuples defaults to the current #tuples in the relation
+
+#include <unistd.h>
+#include "defs.h"
+#include "reln.h"
+#include "rebuild.h"
+
+#define USAGE "./reindex  [-j Nthreads]  RelName  SigType  1/pF  [#tuples]"
+
+// Main ... process args, rebuild signatures
+
+int main(int argc, char **argv)
+{
+	Reln r;  // open relation info
+	char err[MAXERRMSG];  // buffer for error messages
+	char stype;  // signature type
+
+	// process command-line args
+
+	int nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	if (argc > 2 && strcmp(argv[1], "-j") == 0) {
+		nthreads = atoi(argv[2]);
+		argc -= 2; argv += 2;
+	}
+	if (argc < 4) fatal(USAGE, "");
+	if (nthreads < 1) {
+		sprintf(err, "Invalid #threads: %d (must be >= 1)", nthreads);
+		fatal("", err);
+	}
+
+	if ((r = openRelation(argv[1])) == NULL) {
+		sprintf(err, "Can't open relation: %s",argv[1]);
+		fatal("", err);
+	}
+	Count nattrs = nAttrs(r);
+	Count tupsize = tupSize(r);
+	Count ngramAttrs = r->params.ngramAttrs;
+	BigCount ntuples = nTuples(r);
+	Count pagesize = pageSize(r);
+	closeRelation(r);
+
+	// signature type (simc, catc or blkc)
+	if ((strcmp(argv[2], "simc") == 0) || (strcmp(argv[2],"catc") == 0)
+	    || (strcmp(argv[2], "blkc") == 0))
+		stype = argv[2][0];
+	else
+		fatal("", "Invalid signature type (must be simc, catc or blkc)");
+	if (ngramAttrs != 0 && stype == 'c')
+		fatal("", "Relation has n-gram codewords, which need simc or blkc signatures");
+
+	// false match probability
+	float pF = 1.0 / atoi(argv[3]);
+	if (pF > 0.01) {
+		sprintf(err, "Invalid pF: %f (must be > 100)", pF);
+		fatal("", err);
+	}
+
+	// how many tuples expected
+	if (argc > 4) ntuples = atoll(argv[4]);
+	if (ntuples < 10) ntuples = 10;
+
+	Count tk, tm, pm, bm;
+	double psigF = chooseSigParams(nattrs, tupsize, pF, ntuples, ngramAttrs, pagesize,
+	                               &tk, &tm, &pm, &bm);
+	if (psigF > pF)
+		fprintf(stderr, "Page signatures cut to %d bits to fit the pages; "
+		        "their false match probability is about %.3g\n", pm, psigF);
+	if (rebuildSignatures(argv[1], stype, pF, tk, tm, pm, bm, NULL, nthreads) != OK) {
+		sprintf(err, "Can't rebuild signatures for %s (signatures too large for pages?)", argv[1]);
+		fatal("", err);
+	}
+	return 0;
+}
@@ -5,14 +5,24 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <sys/file.h>
+#include <stdio.h>
+#include <math.h>
 #include "defs.h"
 #include "reln.h"
 #include "page.h"
 #include "tuple.h"
 #include "tsig.h"
 #include "psig.h"
+#include "bsig.h"
 #include "bits.h"
 #include "hash.h"
+#include "lhash.h"
+#include "btree.h"
+#include "fsig.h"
+#include "zone.h"
+#include "tbsig.h"
+#include "rebuild.h"
 
 // open a file with a specified suffix
 // - always open for both reading and writing
@@ -26,36 +36,226 @@ File openFile(char *name, char *suffix)
 	return f;
 }
 
-// create a new relation (five files)
-// data file has one empty data page
+// open one of relation r's paged files (e.g. "data")
+// its pages are of the relation's page size
 
-Status newRelation(char *name, Count nattrs, float pF, char sigtype,
-                   Count tk, Count tm, Count pm, Count bm)
+File openRelnFile(Reln r, char *suffix)
 {
-	Reln r = malloc(sizeof(RelnRep));
-	RelnParams *p = &(r->params);
-	assert(r != NULL);
-	p->nattrs = nattrs;
-	p->pF = pF,
+	File f = openFile(r->name, suffix);
+	setPageSize(f, pageSize(r));
+	return f;
+}
+
+// name of the file holding signatures of some kind ("tsig", ...)
+// signature files are rebuilt under a new name (e.g. R.tsig.2)
+// so that they can be swapped in by atomically replacing R.info
+
+void sigFileName(char *fname, int size, char *name, char *kind, Count gen)
+{
+	if (gen == 0)
+		snprintf(fname, size, "%s.%s", name, kind);
+	else
+		snprintf(fname, size, "%s.%s.%d", name, kind, gen);
+}
+
+File openSigFile(Reln r, char *kind, Count gen)
+{
+	char fname[MAXFILENAME+16];
+	sigFileName(fname, sizeof(fname), r->name, kind, gen);
+	File f = open(fname,O_RDWR|O_CREAT,0644);
+	assert(f >= 0);
+	setPageSize(f, pageSize(r));
+	return f;
+}
+
+// set the signature parameters for a relation
+// returns NOT_OK if fewer than 2 psigs or bsigs fit in a page
+
+Status setSigParams(RelnParams *p, char sigtype, Count tk, Count tm, Count pm, Count bm)
+{
+	Count available = (p->pagesize-sizeof(Count));
 	p->sigtype = sigtype;
-	p->tupsize = 28 + 7*(nattrs-2);
-	Count available = (PAGESIZE-sizeof(Count));
-	p->tupPP = available/p->tupsize;
 	p->tk = tk; 
 	if (tm%8 > 0) tm += 8-(tm%8); // round up to byte size
 	p->tm = tm; p->tsigSize = tm/8; p->tsigPP = available/(tm/8);
 	if (pm%8 > 0) pm += 8-(pm%8); // round up to byte size
 	p->pm = pm; p->psigSize = pm/8; p->psigPP = available/(pm/8);
-	if (p->psigPP < 2) { free(r); return -1; }
+	if (p->psigPP < 2) return NOT_OK;
 	if (bm%8 > 0) bm += 8-(bm%8); // round up to byte size
 	p->bm = bm; p->bsigSize = bm/8; p->bsigPP = available/(bm/8);
-	if (p->bsigPP < 2) { free(r); return -1; }
+	if (p->bsigPP < 2) return NOT_OK;
+	// frame-sliced signatures split tm bits evenly among attributes
+	Count fm = iceil(tm, p->nattrs);
+	if (fm%8 > 0) fm += 8-(fm%8);
+	p->fm = fm; p->fsigSize = fm/8; p->fsigPP = available/(fm/8);
+	return OK;
+}
+
+// give attribute i's codewords attrBits[i] bits (simc, blkc), or a
+// share of each catc signature in proportion to attrBits[i]
+// (see sig.c); NULL goes back to tk bits (an equal share) for all
+
+void setAttrBits(RelnParams *p, Count *attrBits)
+{
+	memset(p->attrBits, 0, sizeof(p->attrBits));
+	if (attrBits == NULL) {
+		p->options &= ~ATTR_BITS;
+		return;
+	}
+	p->options |= ATTR_BITS;
+	for (Count i = 0; i < p->nattrs; i++)
+		p->attrBits[i] = attrBits[i];
+}
+
+// parse a schema like "int32,char(20),char(6),int64" into a type
+// and a stored size for each of nattrs attributes
+// returns NOT_OK unless spec gives exactly nattrs valid types
+
+Status parseSchema(char *spec, Count nattrs, char *types, Count *lens)
+{
+	char *c = spec;
+	for (Count i = 0; i < nattrs; i++) {
+		int len, n = 0;
+		if (strncmp(c, "int32", 5) == 0) {
+			types[i] = INT32_ATTR; lens[i] = 4; c += 5;
+		}
+		else if (strncmp(c, "int64", 5) == 0) {
+			types[i] = INT64_ATTR; lens[i] = 8; c += 5;
+		}
+		else if (sscanf(c, "char(%d)%n", &len, &n) == 1 && n > 0
+		         && len > 0 && len < MAXTUPLEN) {
+			types[i] = CHAR_ATTR; lens[i] = len; c += n;
+		}
+		else
+			return NOT_OK;
+		if (*c != ((i == nattrs-1) ? '\0' : ',')) return NOT_OK;
+		c++;
+	}
+	return OK;
+}
+
+// size the tuples of p, and the number of them in a data page,
+// which also holds a tombstone bitmap (one bit per tuple)
+
+static void setTupleSize(RelnParams *p, Count tupsize)
+{
+	Count available = (p->pagesize-sizeof(Count));
+	p->tupsize = tupsize;
+	p->tupPP = available/p->tupsize;
+	while (p->tupPP*p->tupsize + iceil(p->tupPP,8) > available) p->tupPP--;
+}
+
+// store tuples as packed binary values, attribute i having type
+// types[i] and taking lens[i] bytes (see tuple.c); only for a
+// relation with no tuples yet, as it changes the data page layout
+
+void setSchema(RelnParams *p, char *types, Count *lens)
+{
+	assert(p->ntups == 0 && p->ndead == 0);
+	Count size = 0;
+	memset(p->attrType, 0, sizeof(p->attrType));
+	memset(p->attrLen, 0, sizeof(p->attrLen));
+	for (Count i = 0; i < p->nattrs; i++) {
+		p->attrType[i] = types[i];
+		p->attrLen[i] = lens[i];
+		size += lens[i];
+	}
+	p->options |= TYPED_TUPLES;
+	setTupleSize(p, size);
+}
+
+// print the schema of a typed relation, e.g. "int32,char(20)"
+
+void showSchema(RelnParams *p)
+{
+	for (Count i = 0; i < p->nattrs; i++) {
+		if (i > 0) putchar(',');
+		switch (p->attrType[i]) {
+		case INT32_ATTR: printf("int32"); break;
+		case INT64_ATTR: printf("int64"); break;
+		default:         printf("char(%d)", p->attrLen[i]); break;
+		}
+	}
+}
+
+// choose signature parameters for a relation holding about
+// ntuples tuples of nattrs attributes, with false match prob pF
+// and tuples of tupsize bytes
+
+// with n-gram codewords on the attributes in ngramAttrs (bitmask),
+// each trigram counts as one more item superimposed in a signature
+// and pages of pagesize bytes
+// returns the false match probability of the page signatures, which
+// is above pF if they had to be shortened to fit two in a page
+
+double chooseSigParams(Count nattrs, Count tupsize, float pF, BigCount ntuples, Count ngramAttrs,
+                       Count pagesize, Count *tk, Count *tm, Count *pm, Count *bm)
+{
+	Count capacity = (pagesize-sizeof(Count))/tupsize;
+	Count nitems = nattrs + nGramsPerTuple(nattrs, ngramAttrs);
+	double log2 = 1.0/log(2.0);
+	double logF = log(1.0/(double)pF);
+	*tk  = (int)(log2 * logF);
+	*tm  = (int)(log2*log2 * nitems * logF);
+	*pm  = (int)(log2*log2 * nitems*capacity * logF);
+	// HACK: we need a value for bm, but bm = #pages
+	// HACK: we have no pages yet, so size bit-slices
+	// HACK:   for the expected number of tuples
+	*bm  = ntuples / capacity;
+	if (ntuples%capacity > 0) (*bm)++;
+	// at least two page signatures must fit in a page
+	if (*pm <= maxPageSigBits(pagesize)) return pF;
+	*pm = maxPageSigBits(pagesize);
+	return pow(1.0 - exp(-(double)*tk * nitems*capacity / *pm), *tk);
+}
+
+// widest page signature (#bits) of which two fit in a page
+
+Count maxPageSigBits(Count pagesize)
+{
+	return 8*((pagesize-sizeof(Count))/2);
+}
+
+// how many trigrams are superimposed for each tuple
+// a value "v" gives the trigrams of "^v$", i.e. strlen(v) of them
+
+Count nGramsPerTuple(Count nattrs, Count ngramAttrs)
+{
+	Count n = 0;
+	for (Count i = 0; i < nattrs; i++) {
+		if (!(ngramAttrs & (1 << i))) continue;
+		// attribute widths, as in TEXT_TUPSIZE
+		n += (i == 0) ? 7 : (i == 1) ? 20 : 6;
+	}
+	return n;
+}
+
+// create a new relation (five files)
+// data file has one empty data page
+
+Status newRelation(char *name, Count nattrs, float pF, char sigtype,
+                   Count tk, Count tm, Count pm, Count bm, Count pagesize)
+{
+	Reln r = malloc(sizeof(RelnRep));
+	RelnParams *p = &(r->params);
+	assert(r != NULL);
+	memset(p, 0, sizeof(RelnParams));
+	snprintf(r->name, MAXRELNAME, "%s", name);
+	r->hashf = r->hovff = r->btreef = r->fsigf = r->zonef = r->tbsigf = -1;
+	r->pending = NULL;
+	r->snapshot = FALSE;
+	p->nattrs = nattrs;
+	p->pF = pF,
+	p->pagesize = pagesize;
+	setTupleSize(p, TEXT_TUPSIZE(nattrs));
+	if (setSigParams(p, sigtype, tk, tm, pm, bm) != OK) { free(r); return -1; }
+	r->lockf = openFile(name,"lock");
 	r->infof = openFile(name,"info");
-	r->dataf = openFile(name,"data");
-	r->tsigf = openFile(name,"tsig");
-	r->psigf = openFile(name,"psig");
-	r->bsigf = openFile(name,"bsig");
-	addPage(r->dataf); p->npages = 1; p->ntups = 0;
+	r->dataf = openRelnFile(r,"data");
+	r->tsigf = openRelnFile(r,"tsig");
+	r->psigf = openRelnFile(r,"psig");
+	r->bsigf = openRelnFile(r,"bsig");
+	addPage(r->dataf); p->npages = 1; p->ntups = 0; p->bsigSynced = 1;
 	addPage(r->tsigf); p->tsigNpages = 1; p->ntsigs = 0;
 	addPage(r->psigf); p->psigNpages = 1; p->npsigs = 0;
 
@@ -65,20 +265,20 @@ Status newRelation(char *name, Count nattrs, float pF, char sigtype,
 	//TODO
         // create psigBits bitstrings of length nDataPages.
 	addPage(r->bsigf); p->bsigNpages = 1; p->nbsigs = 0; // replace this
-        Bits bsig = newBits(bm);
+        Bits bsig = newBits(p->bm);
         Page bsigpage = getPage(r->bsigf, 0);
-        for (Count i = 0; i < pm; i++) {
+        for (Count i = 0; i < p->pm; i++) {
                if (pageNitems(bsigpage) == p->bsigPP) {
                        putPage(r->bsigf, p->bsigNpages-1, bsigpage);
                        bsigpage = getNewLastPage(&p->bsigNpages, r->bsigf);
-                       if (bsigpage == NULL) return NO_PAGE;
+                       if (bsigpage == NULL) return NOT_OK;
                }
                assert(pageNitems(bsigpage) < p->bsigPP);
                putBits(bsigpage, pageNitems(bsigpage), bsig);
                addOneItem(bsigpage);
                p->nbsigs++;
         }
-
+        putPage(r->bsigf, p->bsigNpages-1, bsigpage);
         free(bsig);
 
 	closeRelation(r);
@@ -100,22 +300,337 @@ Bool existsRelation(char *name)
 	}
 }
 
+// layout of RelnParams in the first release's .info files, which
+// have no header, hold all counts in 32 bits, and have no fields
+// for the access structures added since
+
+typedef struct _BaseParams {
+	unsigned int  npages;
+	unsigned int  ntups;
+	unsigned int  tsigNpages;
+	unsigned int  ntsigs;
+	unsigned int  psigNpages;
+	unsigned int  npsigs;
+	unsigned int  bsigNpages;
+	unsigned int  nbsigs;
+	unsigned int  nattrs;
+	char          sigtype;
+	float         pF;
+	unsigned int  tupsize;
+	unsigned int  tupPP;
+	unsigned int  tk;
+	unsigned int  tm;
+	unsigned int  tsigSize;
+	unsigned int  tsigPP;
+	unsigned int  pm;
+	unsigned int  psigSize;
+	unsigned int  psigPP;
+	unsigned int  bm;
+	unsigned int  bsigSize;
+	unsigned int  bsigPP;
+} BaseParams;
+
+// could p be the parameters of a first-release relation?
+
+static Bool plausibleParams(BaseParams *p)
+{
+	if (p->nattrs < 2 || p->nattrs > MAXATTRS) return FALSE;
+	if (p->sigtype != 'c' && p->sigtype != 's') return FALSE;
+	if (p->tupsize != TEXT_TUPSIZE(p->nattrs) || p->tupPP == 0) return FALSE;
+	return p->tsigSize == p->tm/8 && p->psigSize == p->pm/8 && p->bsigSize == p->bm/8;
+}
+
+// convert first-release parameters to the current layout
+// new fields get the values they stand for
+
+static void upgradeParams(RelnParams *p, BaseParams *old)
+{
+	memset(p, 0, sizeof(RelnParams));
+	p->npages = old->npages; p->ntups = old->ntups;
+	p->tsigNpages = old->tsigNpages; p->ntsigs = old->ntsigs;
+	p->psigNpages = old->psigNpages; p->npsigs = old->npsigs;
+	p->bsigNpages = old->bsigNpages; p->nbsigs = old->nbsigs;
+	p->nattrs = old->nattrs; p->sigtype = old->sigtype; p->pF = old->pF;
+	p->tupsize = old->tupsize; p->tupPP = old->tupPP; p->tk = old->tk;
+	p->tm = old->tm; p->tsigSize = old->tsigSize; p->tsigPP = old->tsigPP;
+	p->pm = old->pm; p->psigSize = old->psigSize; p->psigPP = old->psigPP;
+	p->bm = old->bm; p->bsigSize = old->bsigSize; p->bsigPP = old->bsigPP;
+	p->bsigSynced = p->npages;
+	p->pagesize = PAGESIZE;
+}
+
+// rewrite the data file with its tuples packed into as few pages
+// as hold them (for a relation made before data pages had
+// tombstones, or after vacuum has emptied some pages); every tuple
+// is kept, so deleted ones must already have been vacuumed
+// the pages go through a temporary file, then back over the data
+// file; signatures, indexes and zone maps must be rebuilt afterwards
+
+static void repackDataFile(Reln r)
+{
+	RelnParams *rp = &(r->params);
+	Count size = rp->tupsize;
+	setTupleSize(rp, size);
+	char tmpname[MAXFILENAME+16];
+	snprintf(tmpname, sizeof(tmpname), "%s.data.tmp", r->name);
+	File tmp = open(tmpname, O_RDWR|O_CREAT|O_TRUNC, 0644);
+	assert(tmp >= 0);
+	setPageSize(tmp, pageSize(r));
+	Page out = newPage(tmp);
+	PageID nout = 0;
+	BigCount ntups = 0;
+	for (PageID pid = 0; pid < rp->npages; pid++) {
+		Page p = getPage(r->dataf, pid);
+		for (Count i = 0; i < pageNitems(p); i++) {
+			if (pageNitems(out) == rp->tupPP) {
+				putPage(tmp, nout++, out);
+				out = newPage(tmp);
+			}
+			memcpy(addrInPage(out, pageNitems(out), size), addrInPage(p, i, size), size);
+			addOneItem(out);
+			ntups++;
+		}
+		free(p);
+	}
+	rp->lastNitems = pageNitems(out);
+	putPage(tmp, nout++, out);
+	for (PageID pid = 0; pid < nout; pid++)
+		putPage(r->dataf, pid, getPage(tmp, pid));
+	int ok = ftruncate(r->dataf, (off_t)nout * pageSize(r));
+	assert(ok == 0);
+	close(tmp);
+	unlink(tmpname);
+	rp->npages = nout;
+	rp->ntups = ntups;
+	rp->ndead = 0;
+}
+
+// rebuild the hash and B+-tree indexes from the data file
+// (once tuples have moved to other pages)
+
+static void rebuildIndexes(Reln r)
+{
+	char fname[MAXFILENAME];
+	RelnParams *p = &(r->params);
+	if (hasOption(r, HASH_INDEX)) {
+		p->options &= ~HASH_INDEX;
+		sprintf(fname,"%s.hash",r->name); unlink(fname);
+		sprintf(fname,"%s.hovf",r->name); unlink(fname);
+		newHashIndex(r);
+	}
+	if (hasOption(r, BTREE_INDEX)) {
+		p->options &= ~BTREE_INDEX;
+		sprintf(fname,"%s.btree",r->name); unlink(fname);
+		newBtreeIndex(r, p->battr);
+	}
+}
+
+// Concurrency: one writer at a time, and any number of readers
+// - a writer (openRelation) holds an exclusive flock on the data
+//   file for as long as it has the relation open
+// - a reader (openRelationSnapshot) sees the relation as last
+//   published in .info; the writer publishes whenever it fills a
+//   data page, and on close
+// - tuples and signatures are only ever appended or OR'd into place,
+//   and only the first lastNitems tuples of the last data page are
+//   visible, so readers need no lock to read them
+// - the hash and B+-tree indexes are reorganised in place as they
+//   grow: a writer holds an exclusive flock on the index file while
+//   it adds entries, and a reader a shared one just while it looks
+//   the index up, as last published (see readIndexParams)
+// - other changes that rearrange pages in place (vacuum, swapping
+//   in rebuilt signatures) hold an exclusive flock on R.lock, and
+//   readers hold a shared one while they're open
+
 // set up a relation descriptor from relation name
 // open files, reads information from rel.info
+// a first-release .info (which has no header) is upgraded to the
+// current format by a writer
+// returns NULL if .info is not in a known format
 
-Reln openRelation(char *name)
+static Reln openReln(char *name, Bool snapshot)
 {
 	Reln r = malloc(sizeof(RelnRep));
 	assert(r != NULL);
-	r->infof = openFile(name,"info");
+	r->snapshot = snapshot;
+	r->lockf = openFile(name,"lock");
 	r->dataf = openFile(name,"data");
-	r->tsigf = openFile(name,"tsig");
-	r->psigf = openFile(name,"psig");
-	r->bsigf = openFile(name,"bsig");
-	read(r->infof, &(r->params), sizeof(RelnParams));
+	if (!snapshot) flock(r->dataf, LOCK_EX);
+	flock(r->lockf, LOCK_SH);
+	r->infof = openFile(name,"info");
+	InfoHeader h;
+	BaseParams old;
+	Bool known = FALSE, base = FALSE;
+	off_t size = lseek(r->infof, 0, SEEK_END);
+	if (size == sizeof(h) + sizeof(RelnParams)
+	    && pread(r->infof, &h, sizeof(h), 0) == sizeof(h)
+	    && h.magic == INFO_MAGIC && h.version == INFO_VERSION) {
+		pread(r->infof, &(r->params), sizeof(RelnParams), sizeof(h));
+		known = TRUE;
+	}
+	else if (size == sizeof(old) && pread(r->infof, &old, sizeof(old), 0) == sizeof(old)
+	         && plausibleParams(&old)) {
+		upgradeParams(&(r->params), &old);
+		known = base = TRUE;
+	}
+	if (!known) {
+		close(r->infof); close(r->dataf); close(r->lockf);
+		free(r);
+		return NULL;
+	}
+	if (base && snapshot) {
+		// upgrading rewrites the data and signature files, so is
+		// left to a writer
+		close(r->infof); close(r->dataf); close(r->lockf);
+		free(r);
+		Reln w = openReln(name, FALSE);
+		if (w == NULL) return NULL;
+		closeRelation(w);
+		return openReln(name, TRUE);
+	}
+	snprintf(r->name, MAXRELNAME, "%s", name);
+	setPageSize(r->dataf, pageSize(r));
+	r->tsigf = openSigFile(r,"tsig",r->params.sigGen);
+	r->psigf = openSigFile(r,"psig",r->params.sigGen);
+	r->bsigf = openSigFile(r,"bsig",r->params.sigGen);
+	r->hashf = r->hovff = r->btreef = r->fsigf = r->zonef = r->tbsigf = -1;
+	r->pending = NULL;
+	if (hasOption(r, HASH_INDEX)) openHashIndex(r);
+	if (hasOption(r, BTREE_INDEX)) openBtreeIndex(r);
+	if (hasOption(r, FRAME_SIGS)) openFrameSigs(r);
+	if (hasOption(r, ZONE_MAPS)) openZoneMaps(r);
+	if (hasOption(r, TUPLE_SLICES)) openTupleSlices(r);
+	if (!snapshot) {
+		Page p = getPage(r->dataf, nPages(r)-1);
+		r->params.lastNitems = pageNitems(p);
+		free(p);
+	}
+	if (!snapshot) {
+		flock(r->lockf, LOCK_UN);
+		if (base) {
+			// first-release data pages had no tombstones
+			RelnParams *rp = &(r->params);
+			lockForChange(r);
+			repackDataFile(r);
+			// publishes the new parameters, and releases the lock
+			rebuildRelationSigs(r, rp->sigtype, rp->pF, rp->tk,
+			                    rp->tm, rp->pm, rp->bm, NULL, 1);
+		}
+	}
 	return r;
 }
 
+// open a relation for reading and writing
+
+Reln openRelation(char *name)
+{
+	return openReln(name, FALSE);
+}
+
+// open a read-only snapshot of a relation (see above)
+
+Reln openRelationSnapshot(char *name)
+{
+	return openReln(name, TRUE);
+}
+
+// take/release the lock needed to rearrange pages in place
+// with publish, the new parameters are published in .info before
+// readers can see the changes
+
+void lockForChange(Reln r)
+{
+	assert(!r->snapshot);
+	flock(r->lockf, LOCK_EX);
+}
+
+void unlockForChange(Reln r, Bool publish)
+{
+	if (publish) saveRelationParams(r);
+	flock(r->lockf, LOCK_UN);
+}
+
+// take/release the locks needed to add index entries
+// with publish, the new parameters (e.g. after a bucket split or
+// a new root) are published before readers can look again
+
+void lockIndexes(Reln r)
+{
+	assert(!r->snapshot);
+	if (hasOption(r, HASH_INDEX)) flock(hashFile(r), LOCK_EX);
+	if (hasOption(r, BTREE_INDEX)) flock(btreeFile(r), LOCK_EX);
+}
+
+void unlockIndexes(Reln r, Bool publish)
+{
+	if (publish) saveRelationParams(r);
+	if (hasOption(r, HASH_INDEX)) flock(hashFile(r), LOCK_UN);
+	if (hasOption(r, BTREE_INDEX)) flock(btreeFile(r), LOCK_UN);
+}
+
+// bring a reader's index parameters up to those last published,
+// which describe the index as it now is; called holding the lock
+// on the index (entries for pages beyond the reader's snapshot are
+// ignored by the lookups)
+
+void readIndexParams(Reln r)
+{
+	if (!r->snapshot) return;
+	char fname[MAXFILENAME+8];
+	snprintf(fname,sizeof(fname),"%s.info",r->name);
+	File f = open(fname,O_RDONLY);
+	if (f < 0) return;
+	InfoHeader h;
+	RelnParams p;
+	if (pread(f, &h, sizeof(h), 0) == sizeof(h) && h.magic == INFO_MAGIC
+	    && h.version == INFO_VERSION
+	    && pread(f, &p, sizeof(p), sizeof(h)) == sizeof(p)) {
+		RelnParams *rp = &(r->params);
+		rp->hashNpages = p.hashNpages; rp->hovfNpages = p.hovfNpages;
+		rp->nhentries = p.nhentries;
+		rp->hdepth = p.hdepth; rp->hsplit = p.hsplit;
+		rp->btNpages = p.btNpages; rp->nbtentries = p.nbtentries;
+		rp->btRoot = p.btRoot; rp->btDepth = p.btDepth;
+	}
+	close(f);
+}
+
+// how many tuples on data page pid (in p) are in the relation
+// only the last page can have tuples added since it was published
+
+Count visibleTuples(Reln r, PageID pid, Page p)
+{
+	if (pid == nPages(r)-1 && r->params.lastNitems < pageNitems(p))
+		return r->params.lastNitems;
+	return pageNitems(p);
+}
+
+// copy latest information to .info file
+// written to a temporary file which then replaces .info,
+// so that readers never see a partially written .info
+// pages with bit-slice updates still in memory are published
+// as not yet in the bit-slices
+
+void saveRelationParams(Reln r)
+{
+	char tmpname[MAXFILENAME+8], fname[MAXFILENAME+8];
+	snprintf(tmpname,sizeof(tmpname),"%s.info.tmp",r->name);
+	snprintf(fname,sizeof(fname),"%s.info",r->name);
+	File f = open(tmpname,O_WRONLY|O_CREAT|O_TRUNC,0644);
+	assert(f >= 0);
+	InfoHeader h = { INFO_MAGIC, INFO_VERSION };
+	int n = write(f, &h, sizeof(h));
+	assert(n == sizeof(h));
+	RelnParams p = r->params;
+	if (r->pending != NULL && p.bsigSynced > r->pendFrom)
+		p.bsigSynced = r->pendFrom;
+	n = write(f, &p, sizeof(RelnParams));
+	assert(n == sizeof(RelnParams));
+	close(f);
+	int ok = rename(tmpname, fname);
+	assert(ok == 0);
+}
+
 // release files and descriptor for an open relation
 // copy latest information to .info file
 // note: we don't write ChoiceVector since it doesn't change
@@ -123,85 +638,79 @@ Reln openRelation(char *name)
 void closeRelation(Reln r)
 {
 	// make sure updated global data is put in info file
-	lseek(r->infof, 0, SEEK_SET);
-	int n = write(r->infof, &(r->params), sizeof(RelnParams));
-	assert(n == sizeof(RelnParams));
-	close(r->infof); close(r->dataf);
+	if (!r->snapshot) {
+		flushBitSlices(r);
+		saveRelationParams(r);
+	}
+	close(r->lockf); close(r->infof); close(r->dataf);
 	close(r->tsigf); close(r->psigf); close(r->bsigf);
+	closeHashIndex(r);
+	closeBtreeIndex(r);
+	closeFrameSigs(r);
+	closeZoneMaps(r);
+	closeTupleSlices(r);
 	free(r);
 }
 
-// insert a new tuple into a relation
-// returns page where inserted
-// returns NO_PAGE if insert fails completely
+// write the signature of tuple slot in data page pid into tsigf
+// tsigs are stored by position: pid*tupPP + slot
 
-PageID addToRelation(Reln r, Tuple t)
+static void putTupleSig(Reln r, PageID pid, Count slot, Bits tsig)
 {
-	assert(r != NULL && t != NULL && strlen(t) == tupSize(r));
-	Page datapage, tsigpage, psigpage, bsigpage;  PageID datapid, tsigpid, psigpid;
-	RelnParams *rp = &(r->params);
-	
-	// add tuple to last page
-	datapid = rp->npages-1;
-        datapage = getPage(r->dataf, datapid);
-        if (pageNitems(datapage) == rp->tupPP) {
-                datapid++;
-                free(datapage);
-                datapage = getNewLastPage(&rp->npages, r->dataf);
-                if (datapage == NULL) return NO_PAGE;
-        }
-
-	addTupleToPage(r, datapage, t);
-	rp->ntups++;  //written to disk in closeRelation()
-	putPage(r->dataf, datapid, datapage);
-
-	// compute tuple signature and add to tsigf
-        Bits tsig = makeTupleSig(r, t);
-        tsigpid = rp->tsigNpages-1;
-        tsigpage = getPage(r->tsigf, tsigpid);
-        if (pageNitems(tsigpage) == rp->tsigPP) {
-                tsigpid++;
-                free(tsigpage);
-                tsigpage = getNewLastPage(&rp->tsigNpages, r->tsigf);
-                if (tsigpage == NULL) return NO_PAGE;
+        RelnParams *rp = &(r->params);
+        BigCount pos = pid * rp->tupPP + slot;
+        PageID tsigpid = pos / rp->tsigPP;
+        while (tsigpid >= rp->tsigNpages) {
+                Page p = getNewLastPage(&rp->tsigNpages, r->tsigf);
+                free(p);
         }
-        assert(pageNitems(tsigpage) < rp->tsigPP);
-        putBits(tsigpage, pageNitems(tsigpage), tsig);
-        addOneItem(tsigpage);
-        rp->ntsigs++;
+        Page tsigpage = getPage(r->tsigf, tsigpid);
+        putBits(tsigpage, pos % rp->tsigPP, tsig);
+        while (pageNitems(tsigpage) <= pos % rp->tsigPP)
+                addOneItem(tsigpage);
+        if (rp->ntsigs <= pos) rp->ntsigs = pos + 1;
         putPage(r->tsigf, tsigpid, tsigpage);
-        freeBits(tsig);
-	
+}
 
-	// compute page signature and add to psigf
-        Bits tuppsig = makePageSig(r, t);
-        psigpid = datapid / rp->psigPP;
+// write the page signature of data page pid into psigf
+// with merge, psig is OR'd into the existing page signature
+
+static void putPageSig(Reln r, PageID pid, Bits psig, Bool merge)
+{
+        RelnParams *rp = &(r->params);
+        Page psigpage;
+        PageID psigpid = pid / rp->psigPP;
         if (psigpid > rp->psigNpages - 1) {
                 psigpage = getNewLastPage(&rp->psigNpages, r->psigf);
-                if (psigpage == NULL) return NO_PAGE;
         } else {
                 psigpage = getPage(r->psigf, psigpid);
         }
 
         Bits curpsig = newBits(psigBits(r));
-        getBits(psigpage, datapid % rp->psigPP, curpsig);
-        orBits(curpsig, tuppsig);
-        putBits(psigpage, datapid % rp->psigPP, curpsig);
-        if (rp->npsigs < rp->npages) {
+        if (merge) getBits(psigpage, pid % rp->psigPP, curpsig);
+        orBits(curpsig, psig);
+        putBits(psigpage, pid % rp->psigPP, curpsig);
+        if (rp->npsigs <= pid) {
                 /* if a new data page was added (i.e. datapid was incremented),
                  * then increment the count on the number of psigs. */
                 rp->npsigs++;
                 addOneItem(psigpage);
         }
         putPage(r->psigf, psigpid, psigpage);
+        freeBits(curpsig);
+}
 
+// set bit pid in each bit-slice whose bit is set in psig
+// with rebuild, also clear bit pid in all other bit-slices
 
-	// use page signature to update bit-slices
+static void putBitSlices(Reln r, PageID pid, Bits psig, Bool rebuild)
+{
+        RelnParams *rp = &(r->params);
         Bits bsig = newBits(bsigBits(r));
         PageID bsigpid = -1;
-        bsigpage = NULL;
+        Page bsigpage = NULL;
         for (Count i = 0; i < psigBits(r); i++) {
-                if(!bitIsSet(tuppsig, i)) continue;
+                if (!rebuild && !bitIsSet(psig, i)) continue;
 
                 if (bsigpid != i/rp->bsigPP) {
                         if (bsigpage != NULL) {
@@ -211,20 +720,325 @@ PageID addToRelation(Reln r, Tuple t)
                         bsigpage = getPage(r->bsigf, bsigpid);
                 }
                 getBits(bsigpage, i % rp->bsigPP, bsig);
-                setBit(bsig, datapid);
+                if (bitIsSet(psig, i))
+                        setBit(bsig, pid);
+                else
+                        unsetBit(bsig, pid);
                 putBits(bsigpage, i % rp->bsigPP, bsig);
         }
 
         if (bsigpage != NULL)
                 putPage(r->bsigf, bsigpid, bsigpage);
+        freeBits(bsig);
+}
+
+// insert a new tuple into a relation
+// returns page where inserted
+// returns NO_PAGE if insert fails completely
+
+PageID addToRelation(Reln r, Tuple t)
+{
+	assert(r != NULL && t != NULL && validTuple(r, t));
+	Page datapage;  PageID datapid;
+	RelnParams *rp = &(r->params);
+	
+	// add tuple to last page
+	datapid = rp->npages-1;
+        datapage = getPage(r->dataf, datapid);
+        if (pageNitems(datapage) == rp->tupPP) {
+                // publish the full page before starting a new one
+                if (hasOption(r, TUPLE_SLICES))
+                        syncTupleSlices(r);
+                saveRelationParams(r);
+                datapid++;
+                free(datapage);
+                datapage = getNewLastPage(&rp->npages, r->dataf);
+                if (datapage == NULL) return NO_PAGE;
+        }
+
+	Count slot = pageNitems(datapage);
+	addTupleToPage(r, datapage, t);
+	rp->ntups++;  //written to disk in closeRelation()
+	rp->lastNitems = pageNitems(datapage);
+	putPage(r->dataf, datapid, datapage);
 
+	// index entries move between pages as the indexes grow
+	// new buckets or a new root must be published at once
+	if (hasOption(r, HASH_INDEX) || hasOption(r, BTREE_INDEX)) {
+		PageID nbuckets = rp->hashNpages, root = rp->btRoot;
+		lockIndexes(r);
+		if (hasOption(r, HASH_INDEX))
+			addToHashIndex(r, t, datapid);
+		if (hasOption(r, BTREE_INDEX))
+			addToBtreeIndex(r, t, datapid);
+		unlockIndexes(r, rp->hashNpages != nbuckets || rp->btRoot != root);
+	}
+	if (hasOption(r, FRAME_SIGS))
+		putFrameSigs(r, datapid, slot, t);
+	if (hasOption(r, ZONE_MAPS))
+		addToZoneMap(r, datapid, t);
+
+	// compute tuple signature and add to tsigf
+        Bits tsig = makeTupleSig(r, t);
+        putTupleSig(r, datapid, slot, tsig);
+        freeBits(tsig);
+
+	// compute page signature and add to psigf
+        Bits tuppsig = makePageSig(r, t);
+        putPageSig(r, datapid, tuppsig, TRUE);
+
+	// use page signature to update bit-slices (a block at a time)
+	// deferred bit-slices are brought up to date when next used
+	if (!hasOption(r, DEFER_BSIG) && datapid < bsigBits(r)) {
+		addToBitSlices(r, datapid, tuppsig);
+		rp->bsigSynced = nPages(r);
+	}
+	else if (datapid < rp->bsigSynced)
+		rp->bsigSynced = datapid;  // its psig has changed since
         freeBits(tuppsig);
-        freeBits(curpsig);
-        free(bsig);
 
 	return nPages(r)-1;
 }
 
+// write n signatures of size bytes (perPage to a page) for
+// consecutive positions from pos, one page of f at a time
+
+static void putSigRun(File f, PageID *npages, BigCount *nsigs, Count size,
+                      Count perPage, BigCount pos, Byte *sigs, BigCount n)
+{
+	for (BigCount k = 0; k < n; ) {
+		PageID pid = (pos + k) / perPage;
+		Page p;
+		if (pid < *npages)
+			p = getPage(f, pid);
+		else {
+			p = newPage(f);
+			*npages = pid + 1;
+		}
+		for (; k < n && (pos + k) / perPage == pid; k++) {
+			Count slot = (pos + k) % perPage;
+			memcpy(addrInPage(p, slot, size), sigs + k*size, size);
+			while (pageNitems(p) <= slot)
+				addOneItem(p);
+		}
+		putPage(f, pid, p);
+	}
+	if (*nsigs < pos + n) *nsigs = pos + n;
+}
+
+// insert n tuples into a relation, computing the signatures of
+// whole new data pages with nthreads threads
+// tuples first fill up the last data page, one at a time; the rest
+// go on new pages, whose signatures are written a page at a time
+// returns the last page inserted into (NO_PAGE if there's no room,
+// or if any of the tuples is invalid, in which case none is added)
+
+PageID addTuplesToRelation(Reln r, Tuple *tups, Count n, int nthreads)
+{
+	RelnParams *rp = &(r->params);
+	for (Count i = 0; i < n; i++)
+		if (!validTuple(r, tups[i])) return NO_PAGE;
+	Count done = 0;
+	while (done < n && rp->lastNitems < rp->tupPP) {
+		if (addToRelation(r, tups[done++]) == NO_PAGE) return NO_PAGE;
+	}
+	if (done == n) return nPages(r)-1;
+
+	// format the new data pages
+	saveRelationParams(r);
+	PageID first = nPages(r);
+	Count npages = iceil(n - done, rp->tupPP);
+	Page *pages = malloc(npages * sizeof(Page));
+	Byte *tsigs = malloc(npages * rp->tupPP * rp->tsigSize);
+	Byte *psigs = malloc(npages * rp->psigSize);
+	Byte *fsigs = hasOption(r, FRAME_SIGS) ?
+	              malloc(npages * rp->tupPP * nAttrs(r) * rp->fsigSize) : NULL;
+	assert(pages != NULL && tsigs != NULL && psigs != NULL);
+	for (Count i = 0; i < npages; i++) {
+		pages[i] = newPage(r->dataf);
+		for (Count j = 0; j < rp->tupPP && done + i*rp->tupPP + j < n; j++)
+			addTupleToPage(r, pages[i], tups[done + i*rp->tupPP + j]);
+	}
+	makePageSigs(r, pages, npages, tsigs, psigs, fsigs, nthreads);
+
+	// signatures are positional, so each kind is one run
+	Count nlast = pageNitems(pages[npages-1]);
+	BigCount ntsigs = (BigCount)(npages-1)*rp->tupPP + nlast;
+	putSigRun(r->tsigf, &rp->tsigNpages, &rp->ntsigs, rp->tsigSize, rp->tsigPP,
+	          first*rp->tupPP, tsigs, ntsigs);
+	putSigRun(r->psigf, &rp->psigNpages, &rp->npsigs, rp->psigSize, rp->psigPP,
+	          first, psigs, npages);
+	if (fsigs != NULL)
+		putFrameRun(r, first*rp->tupPP, ntsigs, fsigs);
+	Bits psig = newBits(psigBits(r));
+	for (Count i = 0; i < npages; i++) {
+		PageID pid = first + i;
+		if (!hasOption(r, DEFER_BSIG) && pid < bsigBits(r)) {
+			memcpy(bitsAddr(psig), psigs + i*rp->psigSize, rp->psigSize);
+			addToBitSlices(r, pid, psig);
+		}
+		if (hasOption(r, ZONE_MAPS))
+			resetZoneMap(r, pid, pages[i]);
+		putPage(r->dataf, pid, pages[i]);
+	}
+	freeBits(psig);
+	rp->npages = first + npages;
+	rp->ntups += n - done;
+	rp->lastNitems = nlast;
+	if (!hasOption(r, DEFER_BSIG) && rp->bsigSynced == first)
+		rp->bsigSynced = nPages(r) < bsigBits(r) ? nPages(r) : bsigBits(r);
+	if (hasOption(r, TUPLE_SLICES))
+		syncTupleSlices(r);
+
+	if (hasOption(r, HASH_INDEX) || hasOption(r, BTREE_INDEX)) {
+		lockIndexes(r);
+		for (Count k = done; k < n; k++) {
+			PageID pid = first + (k - done) / rp->tupPP;
+			if (hasOption(r, HASH_INDEX))
+				addToHashIndex(r, tups[k], pid);
+			if (hasOption(r, BTREE_INDEX))
+				addToBtreeIndex(r, tups[k], pid);
+		}
+		unlockIndexes(r, TRUE);
+	}
+	else
+		saveRelationParams(r);
+	free(pages); free(tsigs); free(psigs); free(fsigs);
+	return nPages(r)-1;
+}
+
+// remove index entries for a deleted tuple t from data page pid,
+// unless some live tuple on the page still has the same key
+
+static void removeIndexEntries(Reln r, Tuple t, PageID pid, Page live)
+{
+	char **dvals = tupleVals(r, t);
+	Bool keepHash = FALSE, keepBtree = FALSE;
+	for (Count i = 0; i < pageNitems(live); i++) {
+		Tuple lt = getTupleFromPage(r, live, i);
+		char **lvals = tupleVals(r, lt);
+		if (strcmp(lvals[0], dvals[0]) == 0)
+			keepHash = TRUE;
+		if (hasOption(r, BTREE_INDEX) &&
+		    strcmp(lvals[r->params.battr], dvals[r->params.battr]) == 0)
+			keepBtree = TRUE;
+		freeVals(lvals, nAttrs(r));
+		free(lt);
+	}
+	freeVals(dvals, nAttrs(r));
+	if (hasOption(r, HASH_INDEX) && !keepHash)
+		removeFromHashIndex(r, t, pid);
+	if (hasOption(r, BTREE_INDEX) && !keepBtree)
+		removeFromBtreeIndex(r, t, pid);
+}
+
+// rewrite data page pid without its deleted tuples
+// rebuilds the page's tsigs, psig, bit-slice column, zone map
+// and index entries (its tuple bit-slices are rebuilt afterwards)
+// sets *emptied if no tuples are left on the page
+// returns number of tuples removed
+
+static Count vacuumPage(Reln r, PageID pid, Bool *emptied)
+{
+	Page old = getPage(r->dataf, pid);
+	if (!pageHasDeleted(r, old)) {
+		free(old);
+		return 0;
+	}
+
+	Page live = newPage(r->dataf);
+	Bits psig = newBits(psigBits(r));
+	Count ndead = 0;
+	for (Count i = 0; i < pageNitems(old); i++) {
+		if (tupleIsDeleted(r, old, i)) continue;
+		Tuple t = getTupleFromPage(r, old, i);
+		Count slot = pageNitems(live);
+		addTupleToPage(r, live, t);
+		Bits tsig = makeTupleSig(r, t);
+		putTupleSig(r, pid, slot, tsig);
+		freeBits(tsig);
+		if (hasOption(r, FRAME_SIGS))
+			putFrameSigs(r, pid, slot, t);
+		Bits tpsig = makePageSig(r, t);
+		orBits(psig, tpsig);
+		freeBits(tpsig);
+		free(t);
+	}
+	// slots freed at the end of the page get empty tsigs
+	Bits empty = newBits(tsigBits(r));
+	for (Count i = pageNitems(live); i < pageNitems(old); i++) {
+		putTupleSig(r, pid, i, empty);
+		if (hasOption(r, FRAME_SIGS))
+			putFrameSigs(r, pid, i, NULL);
+	}
+	freeBits(empty);
+	if (hasOption(r, TUPLE_SLICES))
+		invalidateTupleSlices(r, pid);
+
+	putPageSig(r, pid, psig, FALSE);
+	putBitSlices(r, pid, psig, TRUE);
+	freeBits(psig);
+
+	for (Count i = 0; i < pageNitems(old); i++) {
+		if (!tupleIsDeleted(r, old, i)) continue;
+		Tuple t = getTupleFromPage(r, old, i);
+		removeIndexEntries(r, t, pid, live);
+		free(t);
+		ndead++;
+	}
+	free(old);
+	if (pid == nPages(r)-1)
+		r->params.lastNitems = pageNitems(live);
+	if (hasOption(r, ZONE_MAPS))
+		resetZoneMap(r, pid, live);
+	if (pageNitems(live) == 0) *emptied = TRUE;
+	putPage(r->dataf, pid, live);
+	return ndead;
+}
+
+// release the pages that vacuum left empty, by repacking the data
+// file and rebuilding everything that refers to data pages by
+// number; called with the lock for changes held, and returns
+// with it held
+
+static void compactRelation(Reln r)
+{
+	RelnParams *rp = &(r->params);
+	repackDataFile(r);
+	// publishes the new parameters, and releases the lock
+	rebuildRelationSigs(r, rp->sigtype, rp->pF, rp->tk, rp->tm, rp->pm, rp->bm,
+	                    hasOption(r, ATTR_BITS) ? rp->attrBits : NULL, 1);
+	lockForChange(r);
+	rebuildIndexes(r);
+	if (hasOption(r, ZONE_MAPS)) {
+		closeZoneMaps(r);
+		newZoneMaps(r);
+	}
+}
+
+// remove deleted tuples from all data pages, one page at a time
+// if that leaves pages empty, the relation is compacted to fewer
+// pages
+// returns number of tuples removed
+
+BigCount vacuumRelation(Reln r)
+{
+	BigCount nremoved = 0;
+	Bool emptied = FALSE;
+	syncBitSlices(r);
+	lockForChange(r);
+	for (PageID pid = 0; pid < nPages(r); pid++)
+		nremoved += vacuumPage(r, pid, &emptied);
+	r->params.ndead = 0;
+	if (nremoved > 0) r->params.epoch++;  // tuples have moved
+	if (hasOption(r, TUPLE_SLICES))
+		syncTupleSlices(r);
+	if (emptied && nPages(r) > 1)
+		compactRelation(r);
+	unlockForChange(r, TRUE);
+	return nremoved;
+}
+
 // displays info about open Reln (for debugging)
 
 void relationStats(Reln r)
@@ -232,16 +1046,31 @@ void relationStats(Reln r)
 	RelnParams *p = &(r->params);
 	printf("Global Info:\n");
 	printf("Dynamic:\n");
-    printf("  #items:  tuples: %d  tsigs: %d  psigs: %d  bsigs: %d\n",
+    printf("  #items:  tuples: %llu  tsigs: %llu  psigs: %llu  bsigs: %llu\n",
 			p->ntups, p->ntsigs, p->npsigs, p->nbsigs);
-    printf("  #pages:  tuples: %d  tsigs: %d  psigs: %d  bsigs: %d\n",
+    if (p->ndead > 0)
+	printf("  #items:  deleted tuples (not vacuumed): %llu\n", p->ndead);
+    if (p->bsigSynced < p->npages)
+	printf("  #pages:  not yet in bit-slices: %llu\n", p->npages - p->bsigSynced);
+    printf("  #pages:  tuples: %llu  tsigs: %llu  psigs: %llu  bsigs: %llu\n",
 			p->npages, p->tsigNpages, p->psigNpages, p->bsigNpages);
 	printf("Static:\n");
-    printf("  tups   #attrs: %d  size: %d bytes  max/page: %d\n",
+    printf("  pages  size: %d bytes\n", p->pagesize);
+    printf("  tups   #attrs: %d  size: %d bytes  max/page: %d",
 			p->nattrs, p->tupsize, p->tupPP);
+    if (p->options & TYPED_TUPLES) {
+	    printf("  schema: ");
+	    showSchema(p);
+    }
+    printf("\n");
 	printf("  sigs   %s",
-            p->sigtype == 'c' ? "catc" : "simc");
-    if (p->sigtype == 's')
+            p->sigtype == 'c' ? "catc" : p->sigtype == 'b' ? "blkc" : "simc");
+    if (p->options & ATTR_BITS) {
+	    printf("  %s:", p->sigtype == 'c' ? "share/attr" : "bits/attr");
+	    for (Count i = 0; i < p->nattrs; i++)
+		    printf(" %d", p->attrBits[i]);
+    }
+    else if (p->sigtype != 'c')
 	    printf("  bits/attr: %d", p->tk);
     printf("\n");
 	printf("  tsigs  size: %d bits (%d bytes)  max/page: %d\n",
@@ -250,4 +1079,19 @@ void relationStats(Reln r)
 			p->pm, p->psigSize, p->psigPP);
 	printf("  bsigs  size: %d bits (%d bytes)  max/page: %d\n",
 			p->bm, p->bsigSize, p->bsigPP);
+	if (p->options & HASH_INDEX)
+		printf("  hash   attr: 0  buckets: %llu  ovflow pages: %llu  entries: %llu  max/page: %d\n",
+			p->hashNpages, p->hovfNpages, p->nhentries, p->hentPP);
+	if (p->options & FRAME_SIGS)
+		printf("  fsigs  frames: %d  size: %d bits (%d bytes)  max/page: %d  pages: %llu\n",
+			p->nattrs, p->fm, p->fsigSize, p->fsigPP, p->fsigNpages);
+	if (p->options & BTREE_INDEX)
+		printf("  btree  attr: %d  nodes: %llu  levels: %d  entries: %llu  max/node: %d\n",
+			p->battr, p->btNpages, p->btDepth, p->nbtentries, p->btentPP);
+	if (p->options & ZONE_MAPS)
+		printf("  zones  size: %d bytes  max/page: %d  pages: %llu\n",
+			p->zoneSize, p->zonePP, p->zoneNpages);
+	if (p->options & TUPLE_SLICES)
+		printf("  tbsigs size: %d bits (%d bytes)  max/page: %d  pages: %llu  positions in slices: %llu\n",
+			p->tbsigSize*8, p->tbsigSize, p->tbsigPP, p->tbsigNpages, p->tbsigSynced);
 }
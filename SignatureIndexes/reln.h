@@ -10,19 +10,53 @@
 
 // Relation parameters
 
+// .info holds an InfoHeader followed by the RelnParams
+// the version changes whenever the layout of RelnParams (or of
+// anything else on disk) does; see openRelation for upgrades
+
+#define INFO_MAGIC   0x53494758  // "XGIS"
+#define INFO_VERSION 2           // 1 = first release, 32-bit counts, no header
+
+#define MAXATTRS 9  // most attributes in a tuple
+
+// bytes in an untyped tuple, which looks like
+// 7-digits,20-alphas,6-alphanum,... up to nattrs
+#define TEXT_TUPSIZE(N) (28 + 7*((N)-2))
+
+typedef struct _InfoHeader {
+	Count  magic;
+	Count  version;
+} InfoHeader;
+
 typedef struct _RelnParams {
     // dynamic parameters
-	Count  npages;     // number of data pages
-	Count  ntups;      // number of tuples
-	Count  tsigNpages; // number of tsig pages
-	Count  ntsigs;     // number of tuple signatures (tsigs)
-	Count  psigNpages; // number of psig pages
-	Count  npsigs;     // number of page signatures (psigs)
-	Count  bsigNpages; // number of bsig pages
-	Count  nbsigs;     // number of bit-sliced sigs (bsigs)
+	PageID   npages;     // number of data pages
+	BigCount ntups;      // number of tuples (not including deleted ones)
+	BigCount ndead;      // number of deleted tuples not yet vacuumed
+	PageID   tsigNpages; // number of tsig pages
+	BigCount ntsigs;     // number of tuple signatures (tsigs)
+	PageID   psigNpages; // number of psig pages
+	BigCount npsigs;     // number of page signatures (psigs)
+	PageID   bsigNpages; // number of bsig pages
+	BigCount nbsigs;     // number of bit-sliced sigs (bsigs)
+	PageID   hashNpages; // number of primary hash buckets
+	PageID   hovfNpages; // number of hash overflow pages
+	BigCount nhentries;  // number of hash index entries
+	Count    hdepth;     // linear hashing: #hash bits for unsplit buckets
+	PageID   hsplit;     // linear hashing: next bucket to split
+	PageID   btNpages;   // number of B+-tree nodes
+	BigCount nbtentries; // number of B+-tree entries
+	PageID   btRoot;     // B+-tree root node
+	Count    btDepth;    // #levels in B+-tree
+	Bool     btnumeric;  // are all B+-tree keys numbers?
+	double   btmin;      // smallest numeric B+-tree key
+	double   btmax;      // largest numeric B+-tree key
+	PageID   bsigSynced; // data pages whose psigs are in the bit-slices
+	PageID   fsigNpages; // number of frame-sliced signature pages
+	BigCount nfsigs;     // number of frame-sliced signatures
     // fixed parameters (set at relation creation time)
 	Count  nattrs;     // number of attributes
-	char   sigtype;    // CATC == 'c', SIMC == 's'
+	char   sigtype;    // CATC == 'c', SIMC == 's', BLKC == 'b'
 	float  pF;         // false match probability
 	Count  tupsize;    // # bytes in tuples (all same size)
 	Count  tupPP;      // max tuples per page
@@ -36,17 +70,73 @@ typedef struct _RelnParams {
 	Count  bm;         // width of bit-slice (=maxpages)
 	Count  bsigSize;   // # bytes in bit-slice
 	Count  bsigPP;     // max bit-slices per page
+	Count  options;    // optional access structures (see below)
+	Count  hentPP;     // max hash index entries per page
+	Count  sigGen;     // #times signature files were rebuilt
+	Count  battr;      // attribute indexed by B+-tree
+	Count  btentPP;    // max B+-tree entries per node
+	Count  fm;         // width of one frame of a fsig (#bits)
+	Count  fsigSize;   // # bytes in one frame
+	Count  fsigPP;     // max frames per page
+	Count  ngramAttrs; // attributes with n-gram codewords (bitmask)
+	Count  pagesize;   // # bytes in each page of every file
+    // zone maps
+	PageID zoneNpages; // number of zone map pages
+	Count  zoneSize;   // # bytes in a zone map entry
+	Count  zonePP;     // max zone map entries per page
+    // snapshots
+	Count  lastNitems; // tuples on the last data page when published
+    // tuple bit-slices
+	PageID   tbsigNpages; // number of tuple bit-slice pages
+	BigCount tbsigSynced; // tuple positions in the tuple bit-slices
+	Count    tbsigSize;   // # bytes in a tuple bit-slice (8 x positions per group)
+	Count    tbsigPP;     // max tuple bit-slices per page
+    // query result cache
+	Count    epoch;       // bumped when stored tuples change (delete, vacuum)
+    // per-attribute codeword bits
+	Count    attrBits[MAXATTRS]; // bits for each attribute's codewords (if ATTR_BITS)
+    // attribute types
+	Count    attrLen[MAXATTRS];  // # bytes of each stored attribute (if TYPED_TUPLES)
+	char     attrType[MAXATTRS]; // INT32_ATTR, INT64_ATTR or CHAR_ATTR (char(attrLen))
 } RelnParams;
+
+// Optional access structures (bits in RelnParams.options)
+
+#define HASH_INDEX  0x01  // linear hash index on attribute 0
+#define BTREE_INDEX 0x02  // B+-tree index on attribute battr
+#define DEFER_BSIG  0x04  // bit-slices updated lazily (see syncBitSlices)
+#define FRAME_SIGS  0x08  // frame-sliced signatures (see fsig.c)
+#define ZONE_MAPS   0x10  // per-page min/max of numeric values (see zone.c)
+#define TUPLE_SLICES 0x20 // tuple-level bit-slices (see tbsig.c)
+#define ATTR_BITS   0x40  // codeword bits vary by attribute (see tune)
+#define TYPED_TUPLES 0x80 // tuples stored in binary, by a schema (see tuple.c)
+
+// Attribute types (in RelnParams.attrType)
+
+#define INT32_ATTR  'i'
+#define INT64_ATTR  'l'
+#define CHAR_ATTR   'c'
 	
 // Open relation = parameters + open files
 
 typedef struct _RelnRep {
 	RelnParams params; // relation parameters
+	char  name[MAXRELNAME]; // relation name (file prefix)
 	File  infof;  // handle on info file
 	File  dataf;  // handle on data file
 	File  tsigf;  // handle on tuple signature file
 	File  psigf;  // handle on page signature file
 	File  bsigf;  // handle on bit-sliced signature file
+	File  hashf;  // handle on hash index buckets (or -1)
+	File  hovff;  // handle on hash index overflow pages (or -1)
+	File  btreef; // handle on B+-tree index (or -1)
+	File  fsigf;  // handle on frame-sliced signature file (or -1)
+	File  zonef;  // handle on zone map file (or -1)
+	File  tbsigf; // handle on tuple bit-slice file (or -1)
+	PageID pendFrom; // first data page of block with pending bit-slice updates
+	Byte  *pending;  // psigs for that block not yet in bit-slices (or NULL)
+	File  lockf;     // handle on lock file (see lockForChange)
+	Bool  snapshot;  // read-only view of the relation as last published?
 } RelnRep;
 
 typedef struct _RelnRep *Reln;
@@ -54,12 +144,35 @@ typedef struct _RelnRep *Reln;
 #include "tuple.h"
 #include "page.h"
 
+File openFile(char *name, char *suffix);
+File openRelnFile(Reln r, char *suffix);
+void sigFileName(char *fname, int size, char *name, char *kind, Count gen);
+File openSigFile(Reln r, char *kind, Count gen);
+Status setSigParams(RelnParams *p, char sigtype, Count tk, Count tm, Count pm, Count bm);
+void setAttrBits(RelnParams *p, Count *attrBits);
+Status parseSchema(char *spec, Count nattrs, char *types, Count *lens);
+void setSchema(RelnParams *p, char *types, Count *lens);
+void showSchema(RelnParams *p);
+double chooseSigParams(Count nattrs, Count tupsize, float pF, BigCount ntuples, Count ngramAttrs,
+                       Count pagesize, Count *tk, Count *tm, Count *pm, Count *bm);
+Count maxPageSigBits(Count pagesize);
+Count nGramsPerTuple(Count nattrs, Count ngramAttrs);
 Status newRelation(char *name, Count nattrs, float pF, char sigtype,
-				   Count tk, Count tm, Count pm, Count bm);
+				   Count tk, Count tm, Count pm, Count bm, Count pagesize);
 Reln openRelation(char *name);
+Reln openRelationSnapshot(char *name);
 void closeRelation(Reln r);
+void saveRelationParams(Reln r);
+void lockForChange(Reln r);
+void unlockForChange(Reln r, Bool publish);
+void lockIndexes(Reln r);
+void unlockIndexes(Reln r, Bool publish);
+void readIndexParams(Reln r);
+Count visibleTuples(Reln r, PageID pid, Page p);
 Bool existsRelation(char *name);
 PageID addToRelation(Reln r, Tuple t);
+PageID addTuplesToRelation(Reln r, Tuple *tups, Count n, int nthreads);
+BigCount vacuumRelation(Reln r);
 void relationStats(Reln r);
 
 // Convenience marcos
@@ -67,9 +180,11 @@ void relationStats(Reln r);
 #define nAttrs(REL)      (REL)->params.nattrs
 #define tupSize(REL)     (REL)->params.tupsize
 #define sigType(REL)     (REL)->params.sigtype
+#define pageSize(REL)    (REL)->params.pagesize
 
 #define nPages(REL)      (REL)->params.npages
 #define nTuples(REL)     (REL)->params.ntups
+#define nDeleted(REL)    (REL)->params.ndead
 #define maxTupsPP(REL)   (REL)->params.tupPP
 
 #define nTsigPages(REL)  (REL)->params.tsigNpages
@@ -85,13 +200,26 @@ void relationStats(Reln r);
 #define maxBsigsPP(REL)  (REL)->params.bsigPP
 
 #define codeBits(REL)    (REL)->params.tk
+#define attrCodeBits(REL,I) (hasOption(REL,ATTR_BITS) ? (REL)->params.attrBits[I] : codeBits(REL))
 #define tsigBits(REL)    (REL)->params.tm
 #define psigBits(REL)    (REL)->params.pm
 #define bsigBits(REL)    (REL)->params.bm
+#define tsigBytes(REL)   (REL)->params.tsigSize
+#define psigBytes(REL)   (REL)->params.psigSize
 
 #define dataFile(REL)    (REL)->dataf
 #define tsigFile(REL)    (REL)->tsigf
 #define psigFile(REL)    (REL)->psigf
 #define bsigFile(REL)    (REL)->bsigf
+#define hashFile(REL)    (REL)->hashf
+#define hovfFile(REL)    (REL)->hovff
+#define btreeFile(REL)   (REL)->btreef
+#define fsigFile(REL)    (REL)->fsigf
+#define zoneFile(REL)    (REL)->zonef
+
+#define hasOption(REL,O) (((REL)->params.options & (O)) != 0)
+#define hasNgrams(REL,I) ((((REL)->params.ngramAttrs >> (I)) & 1) != 0)
+#define attrType(REL,I)  (hasOption(REL,TYPED_TUPLES) ? (REL)->params.attrType[I] : 0)
+#define isIntAttr(REL,I) (attrType(REL,I) == INT32_ATTR || attrType(REL,I) == INT64_ATTR)
 
 #endif
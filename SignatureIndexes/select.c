@@ -1,15 +1,36 @@
 // select.c ... run queries
 // part of signature indexed files
 // Ask a query on a named relation
-// Usage:  ./select  [-v]  RelName  v1,v2,v3,v4,...  Sigs
+// Usage:  ./select  [-v]  [-x|-X]  [-c]  [-e]  [-s N]  RelName  v1,v2,v3,v4,...  Sigs
 // where any of the vi's can be "?" (unknown)
+//   or a range "lo..hi" (either bound may be omitted)
+//   or a pattern with '*' wildcards (e.g. "abc*", "*abc*"), which is
+//   filtered by signatures if the attribute has n-gram codewords
+//   or a list of alternatives "{a|b|c}" (any of them may match)
+// Several queries separated by ';' are OR'd, e.g. "1,?,?,?;?,x,?,?";
+//   signatures are scanned once for all of them
+// Sigs is t, p, b or f (signature type), T (tuple bit-slices),
+//   h (hash index on attribute 0),
+//   r (B+-tree), a (cheapest by cost estimate)
+//   or omitted (scan all data pages)
+// -x shows the estimated query plan without running the query
+//    (or reading any pages; zone maps are left out of the estimate)
+// -X runs the query and shows actual counts beside the estimates
+// -c uses and updates the relation's result cache (see qcache.c): a
+//    repeated query only searches the data pages added since
+// -e estimates the number of matching tuples, with a 95% interval,
+//    from the candidate pages found by Sigs (default a), without
+//    reading them (see estimateMatches)
+// -s N is -e, but also counts the matches on N of the candidate pages
 
 #include "defs.h"
 #include "query.h"
 #include "tuple.h"
 #include "reln.h"
+#include "plan.h"
+#include "qcache.h"
 
-#define USAGE "./select  [-v]  RelName  v1,v2,v3,v4,...  [t|p|b]"
+#define USAGE "./select  [-v]  [-x|-X]  [-c]  [-e]  [-s N]  RelName  v1,v2,v3,v4,...  [t|p|b|f|T|h|r|a]"
 
 // Main ... process args, run query
 
@@ -18,6 +39,10 @@ int main(int argc, char **argv)
 	Reln r;       // open relation info
 	Query q;      // query iteration information
 	int verbose;  // show extra info on query progress
+	int explain;  // 0 = run query, 'x' = show plan, 'X' = both
+	int cached;   // use the result cache?
+	int estimate; // just estimate the number of matches?
+	int nsample;  // candidate pages to read for the estimate
 	char *rname;  // name of table/file
 	char *qstr;   // query string
 	char  type = '?';   // type of signatures to use
@@ -25,33 +50,90 @@ int main(int argc, char **argv)
 
 	// process command-line args
 
-	if (argc < 3) fatal(USAGE, "");
-	if (strcmp(argv[1], "-v") == 0) {
-		verbose = 1;  rname = argv[2];  qstr = argv[3];
-        if (argc > 4) type = argv[4][0];
-	}
-	else {
-		verbose = 0;  rname = argv[1];  qstr = argv[2];
-		if (argc > 3) type = argv[3][0];
+	verbose = explain = cached = estimate = nsample = 0;
+	int arg = 1;
+	while (arg < argc && argv[arg][0] == '-') {
+		if (strcmp(argv[arg], "-v") == 0)
+			verbose = 1;
+		else if (strcmp(argv[arg], "-x") == 0 || strcmp(argv[arg], "-X") == 0)
+			explain = argv[arg][1];
+		else if (strcmp(argv[arg], "-c") == 0)
+			cached = 1;
+		else if (strcmp(argv[arg], "-e") == 0)
+			estimate = 1;
+		else if (strcmp(argv[arg], "-s") == 0 && arg+1 < argc) {
+			estimate = 1;
+			nsample = atoi(argv[++arg]);
+		}
+		else
+			fatal(USAGE, "");
+		arg++;
 	}
+	if (argc - arg < 2) fatal(USAGE, "");
+	rname = argv[arg];  qstr = argv[arg+1];
+	if (argc - arg > 2) type = argv[arg+2][0];
 
 	if (verbose) { /* keeps compiler quiet */ }
 
 	// initialise relation and scan descriptors
 
-	if ((r = openRelation(rname)) == NULL) {
+	if ((r = openRelationSnapshot(rname)) == NULL) {
 		sprintf(err, "Can't open relation: %s",rname);
 		fatal("", err);
 	}
-	if ((q = startQuery(r, qstr, type)) == NULL) {	
+	if (explain != 0 || estimate) cached = 0;  // plans are for uncached queries
+	if (estimate && type == '?') type = 'a';
+	if (explain == 'x')
+		q = planQuery(r, qstr, type);  // no pages are read
+	else if (cached)
+		q = startCachedQuery(r, qstr, type);
+	else
+		q = startQuery(r, qstr, type);
+	if (q == NULL) {
 		sprintf(err, "Invalid query: %s",qstr);
 		fatal("",err);
 	}
 
+	if (explain == 'x') {
+		explainQuery(q, FALSE);
+		closeQuery(q);
+		closeRelation(r);
+		return 0;
+	}
+
+	if (estimate) {
+		MatchEstimate e;
+		estimateMatches(q, nsample < 0 ? 0 : nsample, &e);
+		if (e.matches < 0)
+			printf("Estimated matches: unknown (at most %.0f; sample pages with -s)\n", e.hi);
+		else if (e.exact)
+			printf("Estimated matches: %.0f (exact)\n", e.matches);
+		else
+			printf("Estimated matches: %.0f (95%% interval %.0f .. %.0f)\n",
+			       e.matches, e.lo, e.hi);
+		printf("# access method:     %s\n", accessMethodName(q->method));
+		printf("# candidate pages:   %llu (about %.0f false matches)\n",
+		       e.candidates, e.nfalse);
+		if (e.nsampled == 0 && e.lo < e.hi)
+			printf("  (matching pages, taken to hold one match each)\n");
+		printf("# sig pages read:    %llu\n", q->nsigpages);
+		printf("# data pages read:   %llu\n", q->ntuppages);
+		closeQuery(q);
+		closeRelation(r);
+		return 0;
+	}
+
 	// scan selected pages to find matching tuples
+	q->display = (explain == 0);
+	if (cached) scanCachedMatches(q);
 	scanAndDisplayMatchingTuples(q);
+	if (cached) saveCachedResult(q);
 
-	printf("Query Stats:\n"); queryStats(q);
+	if (explain == 'X')
+		explainQuery(q, TRUE);
+	else {
+		printf("Query Stats:\n"); queryStats(q);
+	}
 
 	// clean up
 	closeQuery(q);
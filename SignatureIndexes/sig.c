@@ -1,66 +1,188 @@
 #include "hash.h"
+#include "sig.h"
 
 /*
- * Returns a bit string of length m bits with k bits within it set to 1. The
- * k bits are randomly distributed over the least significant u bits of the bitstring.
+ * Sets k bits of b, randomly distributed over the u bits starting at from,
+ * as chosen by the value's hash h (see valueHash).
+ * Uses a private random state (same sequence as srandom/random), so that
+ * signatures can be computed by several threads at once.
  */
-static Bits codeword(char *attr, Count u, Count k, Count m) 
+static void setCodeBits(Bits b, Word h, Count from, Count u, Count k)
 {
-        assert(u <= m);
-        Bits b = newBits(m);
-        if (isUnknownVal(attr)) {
-                return b;
-        }
         Count nbits = 0;
-        srandom(hash_any(attr, strlen(attr)));
+        char state[128];
+        struct random_data rd;
+        memset(&rd, 0, sizeof(rd));
+        initstate_r(h, state, sizeof(state), &rd);
         while(nbits < k) {
-                int i = random() % u;
+                int32_t rnd;
+                random_r(&rd, &rnd);
+                int i = from + rnd % u;
                 if (!bitIsSet(b, i)) {
                         setBit(b, i);
                         nbits++;
                 }
         }
+}
+
+/*
+ * Returns a bit string of length m bits with k bits within it set to 1. The
+ * k bits are randomly distributed over the least significant u bits of the bitstring,
+ * as chosen by h, the hash of the value attr.
+ * Unknown values, ranges and patterns give an all-zero codeword (they match anything).
+ */
+static Bits codeword(char *attr, Word h, Count u, Count k, Count m) 
+{
+        assert(u <= m);
+        Bits b = newBits(m);
+        if (isUnknownVal(attr) || isRangeVal(attr) || isPatternVal(attr)) {
+                return b;
+        }
+        setCodeBits(b, h, 0, u, k);
+        return b;
+}
 
+/*
+ * Returns an m-bit codeword whose k bits all fall in one SIG_BLOCK-bit
+ * (64-byte) block, chosen by the value's hash, as in split-block Bloom
+ * filters; checking it against a stored signature then touches just
+ * that block. The last block also takes the bits left over at the end;
+ * signatures of less than two blocks get an ordinary codeword.
+ */
+static Bits blockCodeword(char *attr, Word h, Count k, Count m)
+{
+        Count nblocks = m / SIG_BLOCK;
+        if (nblocks < 2) return codeword(attr, h, m, k, m);
+        Bits b = newBits(m);
+        if (isUnknownVal(attr) || isRangeVal(attr) || isPatternVal(attr)) {
+                return b;
+        }
+        Count blk = h % nblocks;
+        Count u = (blk == nblocks-1) ? m - blk*SIG_BLOCK : SIG_BLOCK;
+        assert(k <= u);
+        setCodeBits(b, h, blk*SIG_BLOCK, u, k);
         return b;
 }
 
+/*
+ * Fills start[0..nattrs] with the regions of a siglen-bit catc signature:
+ * attribute i's codeword is in bits start[i] .. start[i+1]-1. Regions are
+ * equal, or in proportion to the attributes' bits (ATTR_BITS); attribute
+ * 0's region also takes the bits left over.
+ */
+void catcRegions(Reln r, Count siglen, Count *start)
+{
+        Count width[MAXATTRS];
+        BigCount total = 0;
+        for (Count i = 0; i < nAttrs(r); i++)
+                total += hasOption(r, ATTR_BITS) ? r->params.attrBits[i] : 1;
+        Count used = 0;
+        for (Count i = 1; i < nAttrs(r); i++) {
+                Count share = hasOption(r, ATTR_BITS) ? r->params.attrBits[i] : 1;
+                width[i] = (total == 0) ? 0 : (BigCount)siglen * share / total;
+                used += width[i];
+        }
+        width[0] = siglen - used;
+        start[0] = 0;
+        for (Count i = 0; i < nAttrs(r); i++)
+                start[i+1] = start[i] + width[i];
+}
+
 Bits catcSig(Reln r, Tuple t, Count siglen, Count nTup) 
 {
         Bits sig = newBits(siglen);
         assert(sig != NULL);
         unsetAllBits(sig);
 
-        Count cwlen = (siglen / nAttrs(r));
-        Count nBitsToSet = (cwlen / 2) / nTup;
+        Count start[MAXATTRS+1];
+        catcRegions(r, siglen, start);
         char **attrs = tupleVals(r, t);
-        for (int i = nAttrs(r) - 1; i >= 1; i--) {
-                Bits cw = codeword(attrs[i], cwlen, nBitsToSet, siglen);
-                shiftBits(cw, (i * cwlen) + (siglen % nAttrs(r)));
+        for (int i = nAttrs(r) - 1; i >= 0; i--) {
+                Count cwlen = start[i+1] - start[i];
+                Count nBitsToSet = (cwlen / 2) / nTup;
+                if (hasOption(r, ATTR_BITS) && r->params.attrBits[i] == 0)
+                        nBitsToSet = 0;
+                Bits cw = codeword(attrs[i], valueHash(r, i, attrs[i]),
+                                   cwlen, nBitsToSet, siglen);
+                shiftBits(cw, start[i]);
                 orBits(sig, cw);
                 freeBits(cw);
         }
-
-        cwlen += siglen % nAttrs(r);
-        nBitsToSet = (cwlen / 2) / nTup;
-        Bits cw = codeword(attrs[0], cwlen, nBitsToSet, siglen);
-        orBits(sig, cw);
-        freeBits(cw);
         freeVals(attrs, nAttrs(r));
         return sig;
 }
 
-Bits simcSig(Reln r, Tuple t, Count siglen)
+/*
+ * Superimposes codewords for the trigrams of attribute i's value into sig.
+ * Values are anchored as "^val$"; a '*' in a pattern splits it into
+ * literal parts and drops the anchor at that end, so "ab*" gives "^ab",
+ * "*abc*" gives "abc" and a stored "abcd" gives "^ab","abc","bcd","cd$".
+ * Trigrams are tagged with the attribute number, e.g. "1:abc".
+ */
+#define NGRAM 3
+
+static void addNgramCodewords(Bits sig, int i, char *val, Count siglen, Count k,
+                              Bool blocked)
+{
+        char buf[MAXTUPLEN+3];
+        snprintf(buf, sizeof(buf), "^%s$", val);
+        char *seg = buf;
+        while (seg != NULL) {
+                char *star = strchr(seg, '*');
+                if (star != NULL) *star = '\0';
+                Count len = strlen(seg);
+                for (Count j = 0; j + NGRAM <= len; j++) {
+                        char gram[NGRAM+16];
+                        snprintf(gram, sizeof(gram), "%d:%.*s", i, NGRAM, seg+j);
+                        Word h = hash_any(gram, strlen(gram));
+                        Bits cw = blocked ? blockCodeword(gram, h, k, siglen)
+                                          : codeword(gram, h, siglen, k, siglen);
+                        orBits(sig, cw);
+                        freeBits(cw);
+                }
+                seg = (star == NULL) ? NULL : star+1;
+        }
+}
+
+// superimpose a codeword for each attribute value (and trigram)
+// simc spreads each codeword over the whole signature, blkc keeps
+// each one inside a single block; attribute i's set attrCodeBits bits
+
+static Bits superimposedSig(Reln r, Tuple t, Count siglen, Bool blocked)
 {
         Bits sig = newBits(siglen);
         assert(sig != NULL);
         unsetAllBits(sig);
         char **attrs = tupleVals(r, t);
         for (int i = 0; i < nAttrs(r); i++) {
-                Bits cw = codeword(attrs[i], siglen, codeBits(r), siglen);
+                Count k = attrCodeBits(r, i);
+                Word h = valueHash(r, i, attrs[i]);
+                Bits cw = blocked ? blockCodeword(attrs[i], h, k, siglen)
+                                  : codeword(attrs[i], h, siglen, k, siglen);
                 orBits(sig, cw);
                 freeBits(cw);
+                if (hasNgrams(r, i) && !isUnknownVal(attrs[i]) && !isRangeVal(attrs[i]))
+                        addNgramCodewords(sig, i, attrs[i], siglen, k, blocked);
         }
 
         freeVals(attrs, nAttrs(r));
         return sig;
 }
+
+Bits simcSig(Reln r, Tuple t, Count siglen)
+{
+        return superimposedSig(r, t, siglen, FALSE);
+}
+
+Bits blkcSig(Reln r, Tuple t, Count siglen)
+{
+        return superimposedSig(r, t, siglen, TRUE);
+}
+
+// codeword for attribute i's value in its own frame of fm bits
+
+Bits frameSig(Reln r, Count i, char *attr)
+{
+        Count fm = r->params.fm;
+        return codeword(attr, valueHash(r, i, attr), fm, codeBits(r), fm);
+}
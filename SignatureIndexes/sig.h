@@ -1,5 +1,5 @@
 /*
- * Interface to create catc and simc signatures
+ * Interface to create catc, simc and blkc signatures
  */
 
  #ifndef SIG_H
@@ -9,7 +9,12 @@
 #include "reln.h"
 #include "bits.h"
 
+#define SIG_BLOCK 512  // bits per block of a blkc signature (64 bytes)
+
+void catcRegions(Reln r, Count siglen, Count *start);
 Bits catcSig(Reln r, Tuple t, Count siglen, Count nTup);
 Bits simcSig(Reln r, Tuple t, Count siglen);
+Bits blkcSig(Reln r, Tuple t, Count siglen);
+Bits frameSig(Reln r, Count i, char *attr);
 
  #endif
\ No newline at end of file
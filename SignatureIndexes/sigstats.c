@@ -0,0 +1,503 @@
+// sigstats.c ... show how full a Relation's signatures are
+// part of signature indexed files
+// Scans the tsig, psig and bsig files and shows
+// - histograms of the bits set per signature and per bit position
+//   (slice), as a fraction of the signature's width
+// - the data pages whose psig has more than Pct% of its bits set
+// - the false match rates predicted from the bits set, for queries
+//   with 1, 2 and 3 known attributes
+// With -s N, it also runs N queries for each number of attributes,
+// on the values of randomly chosen stored tuples, and shows the
+// false match rates actually measured (these also show psigs passing
+// pages that hold the query's values in different tuples, which the
+// predictions, from single signatures, leave out)
+// Signatures are best at about half their bits set; well above
+// that, they rule out few tuples/pages, and the relation needs
+// wider signatures (see reindex)
+// Usage:  ./sigstats  [-d Pct]  [-s N]  RelName
+
+#include <math.h>
+#include "defs.h"
+#include "reln.h"
+#include "page.h"
+#include "tuple.h"
+#include "query.h"
+#include "bits.h"
+#include "tsig.h"
+#include "psig.h"
+#include "sig.h"
+
+#define USAGE "./sigstats  [-d Pct]  [-s N]  RelName"
+
+#define NBUCKETS  10  // histogram buckets (of 10% each)
+#define MAXKNOWN  3   // most known attributes in predicted/sampled queries
+#define MAXDENSE  10  // dense pages listed
+
+// bits set in the signatures of one file
+
+typedef struct _SigStats {
+	Count     m;        // bits per signature
+	BigCount  nsigs;    // signatures scanned
+	BigCount *weights;  // weights[w] = #signatures with w bits set
+	BigCount *slices;   // slices[i] = #signatures with bit i set
+	Count     nregions; // parts that codewords are confined to (see sigRegions)
+	Count    *start;    // region g is bits start[g] .. start[g+1]-1
+	BigCount *rweights; // rweights[start[g]+g+w] = #signatures with
+	                    // w bits set in region g
+	BigCount  ndense;   // psigs: #pages with more than Pct% set
+	PageID    dense[MAXDENSE];  // the first of them
+} SigStats;
+
+// false matches found by the sample queries with some #attributes known
+
+typedef struct _Sampled {
+	Count    nqueries;
+	BigCount tfalse, tother;  // tuples: false tsig matches / non-matching
+	BigCount tpfalse;         // pages: false matches via tsigs
+	BigCount pfalse, pother;  // pages: false psig matches / non-matching
+} Sampled;
+
+// each codeword's bits fall in one region of an m-bit signature
+// of type sigtype: catc has a region per attribute, blkc a region
+// per block (see sig.c), and simc (or a bit-slice) just the one
+
+static Count sigRegions(Reln r, char sigtype, Count m, Count **start)
+{
+	Count n = 1;
+	if (sigtype == 'c')
+		n = nAttrs(r);
+	else if (sigtype == 'b' && m / SIG_BLOCK >= 2)
+		n = m / SIG_BLOCK;
+	*start = malloc((n+1) * sizeof(Count));
+	assert(*start != NULL);
+	if (sigtype == 'c') {
+		catcRegions(r, m, *start);
+		return n;
+	}
+	for (Count g = 0; g < n; g++)
+		(*start)[g] = g*SIG_BLOCK;
+	(*start)[n] = m;
+	return n;
+}
+
+static void initSigStats(SigStats *s, Reln r, char sigtype, Count m)
+{
+	s->m = m;
+	s->nsigs = s->ndense = 0;
+	s->weights = calloc(m+1, sizeof(BigCount));
+	s->slices = calloc(m, sizeof(BigCount));
+	s->nregions = sigRegions(r, sigtype, m, &s->start);
+	s->rweights = calloc(m + s->nregions, sizeof(BigCount));
+	assert(s->weights != NULL && s->slices != NULL && s->rweights != NULL);
+}
+
+static void freeSigStats(SigStats *s)
+{
+	free(s->weights);
+	free(s->slices);
+	free(s->start);
+	free(s->rweights);
+}
+
+// add the signature at sig (size bytes) to s; returns its #bits set
+
+static Count addSig(SigStats *s, Byte *sig, Count size)
+{
+	Count w = 0, g = 0, rw = 0;
+	for (Count k = 0; k < size; k++) {
+		Byte byte = sig[k];
+		while (byte != 0) {
+			Count i = k*8 + __builtin_ctz(byte);
+			byte &= byte - 1;
+			if (i >= s->m) break;
+			// bits come in order, so regions are too
+			for (; i >= s->start[g+1]; g++, rw = 0)
+				s->rweights[s->start[g] + g + rw]++;
+			s->slices[i]++;
+			w++; rw++;
+		}
+	}
+	for (; g < s->nregions; g++, rw = 0)
+		s->rweights[s->start[g] + g + rw]++;
+	s->weights[w]++;
+	s->nsigs++;
+	return w;
+}
+
+// tuple positions (pid*tupPP + slot) in the relation's snapshot
+
+static BigCount nPositions(Reln r)
+{
+	if (nPages(r) == 0) return 0;
+	return (nPages(r)-1) * maxTupsPP(r) + r->params.lastNitems;
+}
+
+static void scanTsigs(Reln r, SigStats *s)
+{
+	initSigStats(s, r, sigType(r), tsigBits(r));
+	BigCount upto = nPositions(r);
+	for (PageID pid = 0; pid < nTsigPages(r); pid++) {
+		Page p = getPage(tsigFile(r), pid);
+		for (Count i = 0; i < pageNitems(p); i++) {
+			if (pid * maxTsigsPP(r) + i >= upto) break;
+			addSig(s, addrInPage(p, i, tsigBytes(r)), tsigBytes(r));
+		}
+		free(p);
+	}
+}
+
+// also notes the data pages whose psig is more than pct% set
+
+static void scanPsigs(Reln r, SigStats *s, double pct)
+{
+	initSigStats(s, r, sigType(r), psigBits(r));
+	PageID dpid = 0;
+	for (PageID pid = 0; pid < nPsigPages(r); pid++) {
+		Page p = getPage(psigFile(r), pid);
+		for (Count i = 0; i < pageNitems(p) && dpid < nPages(r); i++, dpid++) {
+			Count w = addSig(s, addrInPage(p, i, psigBytes(r)), psigBytes(r));
+			if (100.0 * w / s->m <= pct) continue;
+			if (s->ndense < MAXDENSE) s->dense[s->ndense] = dpid;
+			s->ndense++;
+		}
+		free(p);
+	}
+}
+
+static void showDensePages(SigStats *s, double pct)
+{
+	printf("  psigs more than %.0f%% set: %llu of %llu", pct, s->ndense, s->nsigs);
+	for (Count i = 0; i < s->ndense && i < MAXDENSE; i++)
+		printf("%s%llu", i == 0 ? "  (data pages " : " ", s->dense[i]);
+	if (s->ndense > 0)
+		printf("%s)", s->ndense > MAXDENSE ? " ..." : "");
+	printf("\n");
+}
+
+// the bit-slices only cover the pages up to bsigSynced; slice i
+// has bit j set if the psig of data page j has bit i set
+
+static void scanBsigs(Reln r, SigStats *s)
+{
+	Count npages = r->params.bsigSynced;
+	initSigStats(s, r, '?', npages);
+	for (PageID pid = 0; pid < nBsigPages(r) && npages > 0; pid++) {
+		Page p = getPage(bsigFile(r), pid);
+		for (Count i = 0; i < pageNitems(p); i++)
+			addSig(s, addrInPage(p, i, r->params.bsigSize), iceil(npages, 8));
+		free(p);
+	}
+}
+
+static void showHistogram(char *what, BigCount *counts, BigCount total)
+{
+	printf("  %s:\n", what);
+	for (Count b = 0; b < NBUCKETS; b++)
+		printf("    %3d-%3d%%  %12llu  %5.1f%%\n", b*100/NBUCKETS, (b+1)*100/NBUCKETS,
+		       counts[b], total == 0 ? 0.0 : 100.0 * counts[b] / total);
+}
+
+static Count bucket(BigCount n, BigCount of)
+{
+	Count b = (of == 0) ? 0 : n * NBUCKETS / of;
+	return (b < NBUCKETS) ? b : NBUCKETS-1;
+}
+
+static void showSigStats(char *name, SigStats *s, char *each, char *slice)
+{
+	BigCount hist[NBUCKETS];
+	BigCount total = 0;
+	Count min = s->m, max = 0;
+	memset(hist, 0, sizeof(hist));
+	for (Count w = 0; w <= s->m; w++) {
+		if (s->weights[w] == 0) continue;
+		hist[bucket(w, s->m)] += s->weights[w];
+		total += (BigCount)w * s->weights[w];
+		if (w < min) min = w;
+		if (w > max) max = w;
+	}
+	printf("%s: %llu of %d bits\n", name, s->nsigs, s->m);
+	if (s->nsigs == 0) return;
+	printf("  bits set: min %d  mean %.1f (%.1f%%)  max %d\n", min,
+	       (double)total / s->nsigs, 100.0 * total / s->nsigs / s->m, max);
+	showHistogram(each, hist, s->nsigs);
+	memset(hist, 0, sizeof(hist));
+	for (Count i = 0; i < s->m; i++)
+		hist[bucket(s->slices[i], s->nsigs)]++;
+	showHistogram(slice, hist, s->m);
+}
+
+// probability that q given bits of an m-bit region all fall
+// among w bits set at random in it
+
+static double coverProb(Count w, Count m, Count q)
+{
+	double p = 1.0;
+	for (Count i = 0; i < q; i++)
+		p *= (i < w) ? (double)(w - i) / (m - i) : 0.0;
+	return p;
+}
+
+// probability that a signature from s has all of the bits set in
+// query signature qsig, i.e. that a non-matching one passes its
+// filter, if the bits of each region were set at random (regions
+// are taken as independent)
+
+static double passRate(SigStats *s, Bits qsig)
+{
+	if (s->nsigs == 0) return 0.0;
+	double p = 1.0;
+	for (Count g = 0; g < s->nregions; g++) {
+		Count m = s->start[g+1] - s->start[g], q = 0;
+		for (Count i = s->start[g]; i < s->start[g+1]; i++)
+			if (bitIsSet(qsig, i)) q++;
+		if (q == 0) continue;
+		double pg = 0.0;
+		for (Count w = q; w <= m; w++)
+			pg += s->rweights[s->start[g] + g + w] * coverProb(w, m, q);
+		p *= pg / s->nsigs;
+	}
+	return p;
+}
+
+// query on the values of tuple t, with only the attributes in known set
+
+static void makeQuery(Reln r, Tuple t, Bool *known, char *buf, int size)
+{
+	char **vals = tupleVals(r, t);
+	buf[0] = '\0';
+	for (Count i = 0; i < nAttrs(r); i++) {
+		if (i > 0) strncat(buf, ",", size - strlen(buf) - 1);
+		strncat(buf, known[i] ? vals[i] : "?", size - strlen(buf) - 1);
+	}
+	freeVals(vals, nAttrs(r));
+}
+
+// can the values of t be used in a query as they are?
+
+static Bool plainValues(Reln r, Tuple t)
+{
+	char **vals = tupleVals(r, t);
+	Bool ok = TRUE;
+	for (Count i = 0; i < nAttrs(r); i++)
+		if (isUnknownVal(vals[i]) || isRangeVal(vals[i]) || isPatternVal(vals[i])
+		    || strpbrk(vals[i], "{|};") != NULL)
+			ok = FALSE;
+	freeVals(vals, nAttrs(r));
+	return ok;
+}
+
+// a randomly chosen live tuple with plain values (NULL if none is found)
+
+static Tuple randomTuple(Reln r)
+{
+	for (int tries = 0; tries < 1000; tries++) {
+		PageID pid = random() % nPages(r);
+		Page p = getPage(dataFile(r), pid);
+		Count n = visibleTuples(r, pid, p);
+		Tuple t = NULL;
+		if (n > 0) {
+			Count slot = random() % n;
+			if (!tupleIsDeleted(r, p, slot))
+				t = getTupleFromPage(r, p, slot);
+		}
+		free(p);
+		if (t != NULL && plainValues(r, t)) return t;
+		free(t);
+	}
+	return NULL;
+}
+
+// the first live tuple with plain values (NULL if there's none)
+
+static Tuple firstTuple(Reln r)
+{
+	for (PageID pid = 0; pid < nPages(r); pid++) {
+		Page p = getPage(dataFile(r), pid);
+		Count n = visibleTuples(r, pid, p);
+		for (Count i = 0; i < n; i++) {
+			if (tupleIsDeleted(r, p, i)) continue;
+			Tuple t = getTupleFromPage(r, p, i);
+			if (plainValues(r, t)) { free(p); return t; }
+			free(t);
+		}
+		free(p);
+	}
+	return NULL;
+}
+
+// run query qtext by scanning every page, then count the tsigs and
+// psigs that pass its filter without a matching tuple/page
+
+static void sampleQuery(Reln r, char *qtext, Sampled *res)
+{
+	Query q = startQuery(r, qtext, '?');
+	assert(q != NULL);
+	q->display = FALSE;
+	q->record = TRUE;
+	scanAndDisplayMatchingTuples(q);
+	Bits truePages = newBits(nPages(r));
+	for (BigCount i = 0; i < q->nfound; i++)
+		setBit(truePages, q->found[i] / maxTupsPP(r));
+	BigCount ntrue = nBitsSet(truePages);
+
+	// tsigs: positions are in order, as are the matches in q->found
+	Bits *qsigs = querySigs(q, makeTupleSig);
+	Bits tpages = newBits(nPages(r));
+	BigCount upto = nPositions(r), ntsigs = 0, next = 0;
+	for (PageID pid = 0; pid < nTsigPages(r); pid++) {
+		Page p = getPage(tsigFile(r), pid);
+		for (Count i = 0; i < pageNitems(p); i++) {
+			BigCount pos = pid * maxTsigsPP(r) + i;
+			if (pos >= upto) break;
+			ntsigs++;
+			while (next < q->nfound && q->found[next] < pos) next++;
+			if (next < q->nfound && q->found[next] == pos) continue;
+			if (!anyQuerySigMatches(q, qsigs, addrInPage(p, i, tsigBytes(r)))) continue;
+			res->tfalse++;
+			if (!bitIsSet(truePages, pos / maxTupsPP(r)))
+				setBit(tpages, pos / maxTupsPP(r));
+		}
+		free(p);
+	}
+	freeQuerySigs(q, qsigs);
+	res->tother += ntsigs - q->nfound;
+	res->tpfalse += nBitsSet(tpages);
+	freeBits(tpages);
+
+	qsigs = querySigs(q, makePageSig);
+	PageID dpid = 0;
+	for (PageID pid = 0; pid < nPsigPages(r); pid++) {
+		Page p = getPage(psigFile(r), pid);
+		for (Count i = 0; i < pageNitems(p) && dpid < nPages(r); i++, dpid++)
+			if (!bitIsSet(truePages, dpid)
+			    && anyQuerySigMatches(q, qsigs, addrInPage(p, i, psigBytes(r))))
+				res->pfalse++;
+		free(p);
+	}
+	freeQuerySigs(q, qsigs);
+	res->pother += nPages(r) - ntrue;
+	freeBits(truePages);
+	closeQuery(q);
+}
+
+// n queries with a known attributes (chosen at random) for each a
+// the seed is fixed, so that runs on the same relation agree
+
+static void sampleQueries(Reln r, Count n, Count maxknown, Sampled *res)
+{
+	char qtext[MAXTUPLEN*2];
+	Bool *known = malloc(nAttrs(r) * sizeof(Bool));
+	assert(known != NULL);
+	srandom(9315);
+	for (Count a = 1; a <= maxknown; a++) {
+		memset(&res[a], 0, sizeof(Sampled));
+		for (Count j = 0; j < n; j++) {
+			Tuple t = randomTuple(r);
+			if (t == NULL) break;
+			memset(known, FALSE, nAttrs(r) * sizeof(Bool));
+			for (Count k = 0; k < a; ) {
+				Count i = random() % nAttrs(r);
+				if (!known[i]) { known[i] = TRUE; k++; }
+			}
+			makeQuery(r, t, known, qtext, sizeof(qtext));
+			free(t);
+			sampleQuery(r, qtext, &res[a]);
+			res[a].nqueries++;
+		}
+	}
+	free(known);
+}
+
+static double rate(BigCount n, BigCount of)
+{
+	return (of == 0) ? 0.0 : (double)n / of;
+}
+
+// predicted (and measured) false match rates, for tuples via tsigs
+// and for data pages via tsigs and psigs (bsigs give the same pages
+// as psigs); query bits are those for the first stored tuple's values
+
+static void showFalseMatches(Reln r, SigStats *ts, SigStats *ps,
+                             Count maxknown, Sampled *res)
+{
+	Tuple t = firstTuple(r);
+	if (t == NULL) return;
+	Bool *known = calloc(nAttrs(r), sizeof(Bool));
+	assert(known != NULL);
+	char qtext[MAXTUPLEN*2];
+	printf("False match rates:\n");
+	printf("  %-14s %6s %9s %9s  %6s %9s\n", "known attrs",
+	       "tbits", "tuples", "pages(t)", "pbits", "pages(p)");
+	for (Count a = 1; a <= maxknown; a++) {
+		known[a-1] = TRUE;
+		makeQuery(r, t, known, qtext, sizeof(qtext));
+		Bits tq = makeTupleSig(r, qtext);
+		Bits pq = makePageSig(r, qtext);
+		Count tbits = nBitsSet(tq), pbits = nBitsSet(pq);
+		double pt = passRate(ts, tq);
+		printf("  %d predicted    %6d %9.6f %9.6f  %6d %9.6f\n", a, tbits, pt,
+		       1.0 - pow(1.0 - pt, maxTupsPP(r)), pbits, passRate(ps, pq));
+		if (res != NULL && res[a].nqueries > 0)
+			printf("  %d measured(%-3d)       %9.6f %9.6f         %9.6f\n", a,
+			       res[a].nqueries, rate(res[a].tfalse, res[a].tother),
+			       rate(res[a].tpfalse, res[a].pother), rate(res[a].pfalse, res[a].pother));
+		freeBits(tq);
+		freeBits(pq);
+	}
+	free(known);
+	free(t);
+}
+
+// Main ... process args, scan signatures
+
+int main(int argc, char **argv)
+{
+	Reln r;          // open relation info
+	double pct = 50; // psigs with more bits set are reported
+	Count nsample = 0;  // sample queries per #known attributes
+	char err[MAXERRMSG];  // buffer for error messages
+
+	// process command-line args
+
+	int arg = 1;
+	while (arg < argc && argv[arg][0] == '-') {
+		if (strcmp(argv[arg], "-d") == 0 && arg+1 < argc)
+			pct = atof(argv[++arg]);
+		else if (strcmp(argv[arg], "-s") == 0 && arg+1 < argc)
+			nsample = atoi(argv[++arg]);
+		else
+			fatal(USAGE, "");
+		arg++;
+	}
+	if (arg >= argc) fatal(USAGE, "");
+
+	if ((r = openRelationSnapshot(argv[arg])) == NULL) {
+		sprintf(err, "Can't open relation: %s",argv[arg]);
+		fatal("", err);
+	}
+
+	SigStats ts, ps, bs;
+	scanTsigs(r, &ts);
+	showSigStats("tsigs", &ts, "tsigs by bits set",
+	             "bit positions by fraction of tsigs setting them");
+	scanPsigs(r, &ps, pct);
+	showSigStats("psigs", &ps, "psigs by bits set",
+	             "bit positions by fraction of psigs setting them");
+	showDensePages(&ps, pct);
+	scanBsigs(r, &bs);
+	showSigStats("bsigs", &bs, "slices by bits set (one per data page)",
+	             "data pages by fraction of slices set for them");
+
+	Count maxknown = nAttrs(r) < MAXKNOWN ? nAttrs(r) : MAXKNOWN;
+	Sampled res[MAXKNOWN+1];
+	if (nsample > 0 && nPages(r) > 0)
+		sampleQueries(r, nsample, maxknown, res);
+	showFalseMatches(r, &ts, &ps, maxknown, nsample > 0 ? res : NULL);
+
+	freeSigStats(&ts);
+	freeSigStats(&ps);
+	freeSigStats(&bs);
+	closeRelation(r);
+	return 0;
+}
@@ -21,7 +21,7 @@ int main(int argc, char **argv)
 
 	// open relation and show stats
 
-	Reln r = openRelation(relname);
+	Reln r = openRelationSnapshot(relname);
 	if (r == NULL) fatal(USAGE,"No such relation");
 	relationStats(r);
 #if 0
@@ -0,0 +1,40 @@
+// sync-bsig.c ... bring deferred bit-slices up to date
+// part of signature indexed files
+// Folds the psigs of data pages added since the last sync into
+// the bit-slices, so that later bit-slice queries don't have to
+// Usage:  ./sync-bsig  RelName
+
+#include "defs.h"
+#include "reln.h"
+#include "bsig.h"
+
+#define USAGE "./sync-bsig  RelName"
+
+// Main ... process args, sync bit-slices
+
+int main(int argc, char **argv)
+{
+	Reln r;  // open relation info
+	char err[MAXERRMSG];  // buffer for error messages
+
+	// process command-line args
+
+	if (argc < 2) fatal(USAGE, "");
+
+	if ((r = openRelation(argv[1])) == NULL) {
+		sprintf(err, "Can't open relation: %s",argv[1]);
+		fatal("", err);
+	}
+
+	PageID before = r->params.bsigSynced;
+	syncBitSlices(r);
+	printf("Synced bit-slices for %llu data pages\n", r->params.bsigSynced - before);
+	if (r->params.bsigSynced < nPages(r))
+		printf("%llu data pages don't fit in the bit-slices (use reindex)\n",
+		       nPages(r) - r->params.bsigSynced);
+
+	// clean up
+
+	closeRelation(r);
+	return 0;
+}
@@ -0,0 +1,218 @@
+// tbsig.c ... functions on tuple-level bit-slices (tbsig's)
+// part of signature indexed files
+// Tuple bit-slices hold the tsigs transposed, in groups of G tuple
+// positions (pid*tupPP + slot, as for tsigs), G = 8*tbsigSize:
+// slice i of group g (bit j = bit i of the tsig at position g*G + j)
+// is item g*tm + i of the file, tbsigPP items to a page.
+// A query ANDs the slices for the bits set in its tsig, reading
+// qbits slices per group rather than every tsig, and gets the same
+// candidate positions as a tsig scan.
+// Slices are built from the tsig file a whole group at a time, once
+// all of the group's positions are on full data pages; positions
+// from tbsigSynced on are found by scanning their tsigs instead.
+
+#include <stdint.h>
+#include <unistd.h>
+#include "defs.h"
+#include "reln.h"
+#include "query.h"
+#include "tsig.h"
+#include "bsig.h"
+#include "tbsig.h"
+
+#define MAX_TBSIG_SIZE 4096  // keeps a group's slices small for large pages
+
+#define groupSize(REL) ((BigCount)(REL)->params.tbsigSize * 8)
+
+// add tuple bit-slices to a relation and build them
+// from the tsigs already in the tsig file
+
+void newTupleSlices(Reln r)
+{
+	RelnParams *rp = &(r->params);
+	rp->options |= TUPLE_SLICES;
+	rp->tbsigNpages = 0;
+	rp->tbsigSynced = 0;
+	rp->tbsigSize = (pageSize(r) - sizeof(Count)) & ~7;
+	if (rp->tbsigSize > MAX_TBSIG_SIZE) rp->tbsigSize = MAX_TBSIG_SIZE;
+	rp->tbsigPP = (pageSize(r) - sizeof(Count)) / rp->tbsigSize;
+	openTupleSlices(r);
+	int ok = ftruncate(r->tbsigf, 0);
+	assert(ok == 0);
+	syncTupleSlices(r);
+}
+
+void openTupleSlices(Reln r)
+{
+	r->tbsigf = openSigFile(r, "tbsig", r->params.sigGen);
+}
+
+void closeTupleSlices(Reln r)
+{
+	if (r->tbsigf >= 0) close(r->tbsigf);
+	r->tbsigf = -1;
+}
+
+// copy the tsigs of positions pos .. pos+n-1 into sigs
+// (tsigPage holds tsig page *tpid, and is replaced as needed)
+// positions with no tsig get an empty one
+
+static void getTupleSigs(Reln r, BigCount pos, Count n, Byte *sigs,
+                         Page *tsigPage, PageID *tpid)
+{
+	RelnParams *rp = &(r->params);
+	for (Count j = 0; j < n; j++, pos++) {
+		PageID pid = pos / rp->tsigPP;
+		Count slot = pos % rp->tsigPP;
+		if (pid != *tpid) {
+			free(*tsigPage);
+			*tsigPage = (pid < nTsigPages(r)) ? getPage(tsigFile(r), pid) : NULL;
+			*tpid = pid;
+		}
+		if (*tsigPage == NULL || slot >= pageNitems(*tsigPage))
+			memset(sigs + j*rp->tsigSize, 0, rp->tsigSize);
+		else
+			memcpy(sigs + j*rp->tsigSize,
+			       addrInPage(*tsigPage, slot, rp->tsigSize), rp->tsigSize);
+	}
+}
+
+// transpose the tsigs of group g into its tm slices, 64 positions
+// at a time, and write them out in one pass over their pages
+
+static void buildGroup(Reln r, BigCount g)
+{
+	RelnParams *rp = &(r->params);
+	BigCount base = g * groupSize(r);
+	Byte *slices = calloc(rp->tm, rp->tbsigSize);
+	Byte *sigs = malloc(64 * rp->tsigSize);
+	uint64_t *words = malloc(rp->tsigSize * 8 * sizeof(uint64_t));
+	assert(slices != NULL && sigs != NULL && words != NULL);
+	Page tsigPage = NULL;
+	PageID tpid = NO_PAGE;
+	for (Count off = 0; off < rp->tbsigSize; off += 8) {
+		getTupleSigs(r, base + off*8, 64, sigs, &tsigPage, &tpid);
+		transposeSigs(sigs, 64, rp->tsigSize, words);
+		for (Count i = 0; i < rp->tm; i++) {
+			Byte *slice = slices + i*rp->tbsigSize + off;
+			for (Count k = 0; k < 8; k++)
+				slice[k] = (Byte)(words[i] >> (8*k));
+		}
+	}
+	free(tsigPage);
+
+	BigCount first = g * rp->tm;
+	Page p = NULL;
+	PageID pid = NO_PAGE;
+	for (Count i = 0; i < rp->tm; i++) {
+		BigCount item = first + i;
+		if (item / rp->tbsigPP != pid) {
+			if (p != NULL) putPage(r->tbsigf, pid, p);
+			pid = item / rp->tbsigPP;
+			if (pid < rp->tbsigNpages)
+				p = getPage(r->tbsigf, pid);
+			else {
+				p = newPage(r->tbsigf);
+				rp->tbsigNpages = pid + 1;
+			}
+		}
+		Count slot = item % rp->tbsigPP;
+		memcpy(addrInPage(p, slot, rp->tbsigSize), slices + i*rp->tbsigSize, rp->tbsigSize);
+		while (pageNitems(p) <= slot)
+			addOneItem(p);
+	}
+	if (p != NULL) putPage(r->tbsigf, pid, p);
+	free(slices); free(sigs); free(words);
+}
+
+// build the slices of every group whose positions are all on
+// full data pages (which no longer change, except by vacuum)
+
+void syncTupleSlices(Reln r)
+{
+	RelnParams *rp = &(r->params);
+	PageID full = (rp->lastNitems == rp->tupPP) ? nPages(r) : nPages(r)-1;
+	BigCount upto = (BigCount)full * rp->tupPP;
+	while (rp->tbsigSynced + groupSize(r) <= upto) {
+		buildGroup(r, rp->tbsigSynced / groupSize(r));
+		rp->tbsigSynced += groupSize(r);
+	}
+}
+
+// the tsigs of data page pid have been rewritten (e.g. by vacuum),
+// so its group must be built again
+
+void invalidateTupleSlices(Reln r, PageID pid)
+{
+	RelnParams *rp = &(r->params);
+	BigCount pos = (BigCount)pid * rp->tupPP;
+	if (pos < rp->tbsigSynced)
+		rp->tbsigSynced = pos / groupSize(r) * groupSize(r);
+}
+
+// find "matching" pages using tuple bit-slices
+// each slice is read once per group, and AND'd into the candidate
+// positions of every disjunct whose query signature needs it
+
+void findPagesUsingTupleSlices(Query q)
+{
+	assert(q != NULL);
+	Reln r = q->rel;
+	RelnParams *rp = &(r->params);
+	Count nq = q->ndisjuncts;
+	Bits *qsigs = querySigs(q, makeTupleSig);
+	Bits *match = malloc(nq * sizeof(Bits));
+	assert(match != NULL);
+	unsetAllBits(q->pages);
+	for (Count d = 0; d < nq; d++) {
+		// a disjunct with no bits set matches every page
+		if (nBitsSet(qsigs[d]) == 0) setAllBits(q->pages);
+		match[d] = newBits(groupSize(r));
+	}
+
+	Bits slice = newBits(groupSize(r));
+	for (BigCount g = 0; g < rp->tbsigSynced / groupSize(r); g++) {
+		for (Count d = 0; d < nq; d++)
+			setAllBits(match[d]);
+		Page p = NULL;
+		PageID pid = NO_PAGE;
+		for (Count i = 0; i < rp->tm; i++) {
+			Count d;
+			for (d = 0; d < nq; d++)
+				if (bitIsSet(qsigs[d], i)) break;
+			if (d == nq) continue;
+
+			BigCount item = g * rp->tm + i;
+			if (item / rp->tbsigPP != pid) {
+				free(p);
+				pid = item / rp->tbsigPP;
+				p = getPage(r->tbsigf, pid);
+				q->nsigpages++;
+			}
+			q->nsigs++;
+			getBits(p, item % rp->tbsigPP, slice);
+			for (; d < nq; d++)
+				if (bitIsSet(qsigs[d], i)) andBits(match[d], slice);
+		}
+		free(p);
+
+		BigCount base = g * groupSize(r);
+		for (Count d = 0; d < nq; d++) {
+			if (nBitsSet(qsigs[d]) == 0) continue;
+			for (BigCount j = 0; j < groupSize(r); j++) {
+				if (!bitIsSet(match[d], j)) continue;
+				PageID dpid = (base + j) / maxTupsPP(r);
+				if (dpid >= nPages(r)) break;
+				setBit(q->pages, dpid);
+			}
+		}
+	}
+	freeBits(slice);
+
+	// positions not yet in the slices
+	scanTupleSigs(q, qsigs, rp->tbsigSynced);
+	for (Count d = 0; d < nq; d++)
+		freeBits(match[d]);
+	free(match);
+	freeQuerySigs(q, qsigs);
+}
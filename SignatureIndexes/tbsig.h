@@ -0,0 +1,20 @@
+// tbsig.h ... interface to functions on tuple-level bit-slices
+// part of signature indexed files
+// See tbsig.c for details of the file layout
+
+#ifndef TBSIG_H
+#define TBSIG_H 1
+
+#include "defs.h"
+#include "query.h"
+#include "reln.h"
+#include "bits.h"
+
+void newTupleSlices(Reln);
+void openTupleSlices(Reln);
+void closeTupleSlices(Reln);
+void syncTupleSlices(Reln);
+void invalidateTupleSlices(Reln, PageID);
+void findPagesUsingTupleSlices(Query);
+
+#endif
@@ -27,6 +27,9 @@ Bits makeTupleSig(Reln r, Tuple t)
         case 's':
                 tsig = simcSig(r, t, tsigBits(r));
                 break;
+        case 'b':
+                tsig = blkcSig(r, t, tsigBits(r));
+                break;
         default: 
                 tsig = newBits(tsigBits(r));
                 assert(tsig != NULL);
@@ -37,31 +40,37 @@ Bits makeTupleSig(Reln r, Tuple t)
 }
 
 
-// find "matching" pages using tuple signatures
+// add to q->pages the pages with a tuple signature at
+// position from (pid*tupPP + slot) onwards matching a disjunct
 
-void findPagesUsingTupSigs(Query q)
+void scanTupleSigs(Query q, Bits *qsigs, BigCount from)
 {
-	assert(q != NULL);
-        Bits qsig = makeTupleSig(q->rel, q->qstring);
-        unsetAllBits(q->pages);
-
-        Bits tsig = newBits(tsigBits(q->rel));
-        assert(tsig != NULL);
-        for (PageID tpid = 0; tpid < nTsigPages(q->rel); tpid++) {
+        for (PageID tpid = from / maxTsigsPP(q->rel); tpid < nTsigPages(q->rel); tpid++) {
                Page p = getPage(tsigFile(q->rel), tpid);
                q->nsigpages++;
-               for(Count i = 0; i < pageNitems(p); i++) {
-                       getBits(p, i, tsig);
-                       if(isSubset(qsig, tsig)) {
-                               PageID dpid = q->nsigs / maxTupsPP(q->rel);
-                               setBit(q->pages, dpid);
+               Count i = (tpid == from / maxTsigsPP(q->rel)) ? from % maxTsigsPP(q->rel) : 0;
+               for(; i < pageNitems(p); i++) {
+                       Byte *tsig = addrInPage(p, i, tsigBytes(q->rel));
+                       if(anyQuerySigMatches(q, qsigs, tsig)) {
+                               // tsigs are stored by position: pid*tupPP + slot
+                               BigCount pos = tpid * maxTsigsPP(q->rel) + i;
+                               PageID dpid = pos / maxTupsPP(q->rel);
+                               if (dpid < nPages(q->rel))
+                                       setBit(q->pages, dpid);
                        }
                        q->nsigs++;
                }
                free(p);
         }
+}
 
-        freeBits(tsig);
-        freeBits(qsig);
+// find "matching" pages using tuple signatures
 
+void findPagesUsingTupSigs(Query q)
+{
+	assert(q != NULL);
+        Bits *qsigs = querySigs(q, makeTupleSig);
+        unsetAllBits(q->pages);
+        scanTupleSigs(q, qsigs, q->from * maxTupsPP(q->rel));
+        freeQuerySigs(q, qsigs);
 }
@@ -11,5 +11,6 @@
 #include "bits.h"
 
 Bits makeTupleSig(Reln, Tuple);
+void scanTupleSigs(Query, Bits *, BigCount);
 void findPagesUsingTupSigs(Query);
 #endif
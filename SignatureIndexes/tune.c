@@ -0,0 +1,343 @@
+// tune.c ... tune signature parameters to a query workload
+// part of signature indexed files
+// Reads a log of queries (one per line, as given to select) and
+// gives each attribute codeword bits in line with how often queries
+// know its value: attributes that are never queried get none, and
+// those queried most get the most. The budgets are chosen greedily,
+// a bit at a time, to cut the workload's predicted false match rate
+// the most, until it is below pF; signatures are then sized for
+// them (half their bits set), using the relation's actual tuples
+// per page, and rebuilt (as for reindex).
+// For catc signatures, the budgets are the widths of the attributes'
+// regions (and, in psigs, their shares); for simc and blkc, they are
+// the bits set per codeword. Frame-sliced signatures keep tk bits
+// (unless that would fill more than half of their smaller frames).
+// Page reads for the logged queries, via tsigs, psigs and bit-slices,
+// are estimated (see plan.c) and measured before and after.
+// Usage:  ./tune  [-n]  [-j Nthreads]  RelName  QueryLog  [1/pF]
+// where -n just shows the new parameters, without rebuilding
+
+#include <math.h>
+#include <unistd.h>
+#include "defs.h"
+#include "reln.h"
+#include "query.h"
+#include "tuple.h"
+#include "plan.h"
+#include "rebuild.h"
+#include "sig.h"
+
+#define USAGE "./tune  [-n]  [-j Nthreads]  RelName  QueryLog  [1/pF]"
+
+#define MAXBITS    64    // most codeword bits (or catc region bits) per attribute
+#define NMASKS     (1 << MAXATTRS)
+#define NMETHODS   3
+
+static char methods[NMETHODS] = { 't', 'p', 'b' };
+
+// which attributes the disjuncts of the logged queries know
+
+typedef struct _Workload {
+	Count   nqueries;
+	char  **queries;
+	Count   ndisjuncts;
+	double  masks[NMASKS];  // masks[m] = #disjuncts knowing just the attributes in m
+	Count   ngrams[MAXATTRS];  // trigrams per value of each attribute
+} Workload;
+
+// signature parameters
+
+typedef struct _Params {
+	char  sigtype;
+	Count tk, tm, pm, bm;
+	Count bits[MAXATTRS];  // as RelnParams.attrBits
+} Params;
+
+// which attributes in disjunct q have a value that gives codeword bits
+
+static Count knownMask(Reln r, char *q)
+{
+	char **vals = tupleVals(r, q);
+	Count mask = 0;
+	for (Count i = 0; i < nAttrs(r); i++) {
+		if (isUnknownVal(vals[i]) || isRangeVal(vals[i])) continue;
+		if (isPatternVal(vals[i]) && !hasNgrams(r, i)) continue;
+		mask |= 1 << i;
+	}
+	freeVals(vals, nAttrs(r));
+	return mask;
+}
+
+// read the queries in the log, skipping invalid ones
+
+static void readWorkload(Reln r, FILE *f, Workload *w)
+{
+	char line[MAXTUPLEN*8];
+	Count max = 64;
+	memset(w, 0, sizeof(Workload));
+	w->queries = malloc(max * sizeof(char *));
+	assert(w->queries != NULL);
+	while (fgets(line, sizeof(line), f) != NULL) {
+		line[strcspn(line, "\n")] = '\0';
+		if (line[0] == '\0' || line[0] == '#') continue;
+		Query q = newQuery(r, line);
+		if (q == NULL) {
+			fprintf(stderr, "Skipping invalid query: %s\n", line);
+			continue;
+		}
+		for (Count d = 0; d < q->ndisjuncts; d++)
+			w->masks[knownMask(r, q->disjuncts[d])]++;
+		w->ndisjuncts += q->ndisjuncts;
+		closeQuery(q);
+		if (w->nqueries == max) {
+			max *= 2;
+			w->queries = realloc(w->queries, max * sizeof(char *));
+			assert(w->queries != NULL);
+		}
+		w->queries[w->nqueries++] = strdup(line);
+	}
+	for (Count i = 0; i < nAttrs(r); i++)
+		w->ngrams[i] = nGramsPerTuple(i+1, r->params.ngramAttrs & (1 << i));
+}
+
+// the current parameters of relation r
+// (for catc, the bits are the widths of the tsig regions)
+
+static void currentParams(Reln r, Params *p)
+{
+	RelnParams *rp = &(r->params);
+	p->sigtype = rp->sigtype;
+	p->tk = rp->tk; p->tm = rp->tm; p->pm = rp->pm; p->bm = rp->bm;
+	Count start[MAXATTRS+1];
+	catcRegions(r, rp->tm, start);
+	for (Count i = 0; i < rp->nattrs; i++)
+		p->bits[i] = (rp->sigtype == 'c') ? start[i+1] - start[i] : attrCodeBits(r, i);
+}
+
+// probability that a non-matching tsig passes the filter for a
+// value of each attribute in mask, with parameters p
+// tm == 0 means tsigs sized for the bits (half of them set)
+
+static double passRate(Reln r, Workload *w, Params *p, Count tm, Count mask)
+{
+	double pass = 1.0;
+	if (p->sigtype == 'c') {
+		// a codeword of b = w/2 bits in a w-bit region covers
+		// another with probability 1/C(w,b)
+		BigCount total = 0;
+		for (Count i = 0; i < nAttrs(r); i++) total += p->bits[i];
+		for (Count i = 0; i < nAttrs(r); i++) {
+			if (!(mask & (1 << i))) continue;
+			double width = (tm == 0) ? p->bits[i]
+			             : floor((double)tm * p->bits[i] / fmax(1.0, total));
+			double b = floor(width / 2);
+			pass *= exp(lgamma(b+1) + lgamma(width-b+1) - lgamma(width+1));
+		}
+		return pass;
+	}
+	Count nbits = 0, qbits = 0;
+	for (Count i = 0; i < nAttrs(r); i++) {
+		nbits += p->bits[i] * (1 + w->ngrams[i]);
+		if (mask & (1 << i)) qbits += p->bits[i];
+	}
+	double d = (tm == 0) ? 0.5 : 1.0 - exp(-(double)nbits / tm);
+	return pow(d, qbits);
+}
+
+// predicted tsig false match rate over the workload's disjuncts
+// (disjuncts with nothing known match every tuple, and are left out)
+
+static double falseRate(Reln r, Workload *w, Params *p, Count tm)
+{
+	double n = 0, sum = 0;
+	for (Count m = 1; m < (1 << nAttrs(r)); m++) {
+		if (w->masks[m] == 0) continue;
+		n += w->masks[m];
+		sum += w->masks[m] * passRate(r, w, p, tm, m);
+	}
+	return (n == 0) ? 0.0 : sum / n;
+}
+
+// choose per-attribute bits, one at a time, each to the attribute
+// whose extra bit cuts the predicted false match rate the most,
+// then size the signatures for them
+// a catc codeword only gains a bit for every two region bits, so
+// there steps of two are weighed too (by the cut per bit)
+
+static void chooseParams(Reln r, Workload *w, float pF, Params *p)
+{
+	RelnParams *rp = &(r->params);
+	memset(p, 0, sizeof(Params));
+	p->sigtype = rp->sigtype;
+	p->tk = rp->tk;
+	Count maxstep = (p->sigtype == 'c') ? 2 : 1;
+	double rate = falseRate(r, w, p, 0);
+	while (rate > pF) {
+		int best = -1;
+		Count bestStep = 0;
+		double bestCut = 0, bestRate = rate;
+		for (Count i = 0; i < nAttrs(r); i++) {
+			for (Count step = 1; step <= maxstep; step++) {
+				if (p->bits[i] + step > MAXBITS) continue;
+				p->bits[i] += step;
+				double next = falseRate(r, w, p, 0);
+				p->bits[i] -= step;
+				if ((rate - next) / step > bestCut) {
+					best = i; bestStep = step;
+					bestCut = (rate - next) / step;
+					bestRate = next;
+				}
+			}
+		}
+		if (best < 0) break;
+		p->bits[best] += bestStep;
+		rate = bestRate;
+	}
+
+	Count nbits = 0, maxbits = 0;
+	for (Count i = 0; i < nAttrs(r); i++) {
+		nbits += p->bits[i] * (p->sigtype == 'c' ? 1 : 1 + w->ngrams[i]);
+		if (p->bits[i] > maxbits) maxbits = p->bits[i];
+	}
+	p->tm = (p->sigtype == 'c') ? nbits : (Count)ceil(nbits / log(2.0));
+	if (p->tm < maxbits) p->tm = maxbits;
+	if (p->tm < 8) p->tm = 8;
+	// psigs superimpose the tuples of a page; at least two must fit in a page
+	Count maxpm = maxPageSigBits(rp->pagesize);
+	BigCount pm = (BigCount)p->tm * rp->tupPP;
+	p->pm = (pm > maxpm) ? maxpm : pm;
+	p->bm = rp->bm;
+	// frames get tm/nattrs bits (see setSigParams); keep them half set
+	Count fm = iceil(p->tm, nAttrs(r));
+	fm = iceil(fm, 8) * 8;
+	if (hasOption(r, FRAME_SIGS) && p->tk > fm/2) p->tk = fm/2;
+}
+
+// estimated and measured page reads over the logged queries,
+// via each method
+
+static void pageReads(char *name, Workload *w, double *est, BigCount *actual)
+{
+	Reln r = openRelationSnapshot(name);
+	assert(r != NULL);
+	for (Count m = 0; m < NMETHODS; m++) {
+		est[m] = 0;
+		actual[m] = 0;
+		for (Count i = 0; i < w->nqueries; i++) {
+			Query q = newQuery(r, w->queries[i]);
+			QueryPlan plan;
+			estimatePlan(q, methods[m], &plan);
+			est[m] += plan.cost;
+			findQueryPages(q, methods[m]);
+			q->display = FALSE;
+			scanAndDisplayMatchingTuples(q);
+			actual[m] += q->nsigpages + q->ntuppages;
+			closeQuery(q);
+		}
+	}
+	closeRelation(r);
+}
+
+static void showParams(Reln r, Workload *w, Params *old, Params *new, float pF)
+{
+	printf("Workload: %d queries, %d disjuncts\n", w->nqueries, w->ndisjuncts);
+	printf("  attr  queried  %s now  new\n", old->sigtype == 'c' ? "share" : " bits");
+	for (Count i = 0; i < nAttrs(r); i++) {
+		double n = 0;
+		for (Count m = 0; m < NMASKS; m++)
+			if (m & (1 << i)) n += w->masks[m];
+		printf("  %4d  %6.1f%%  %8d  %4d\n", i,
+		       100.0 * n / fmax(1.0, w->ndisjuncts), old->bits[i], new->bits[i]);
+	}
+	printf("  tsig bits: %d -> %d  psig bits: %d -> %d\n",
+	       old->tm, new->tm, old->pm, new->pm);
+	printf("  predicted tuple false match rate: %.6f -> %.6f (pF %.6f)\n",
+	       falseRate(r, w, old, old->tm), falseRate(r, w, new, new->tm), pF);
+}
+
+static void showPageReads(char *when, double *est, BigCount *actual)
+{
+	for (Count m = 0; m < NMETHODS; m++)
+		printf("  %-6s  %c  %12.1f  %10llu\n", when, methods[m], est[m], actual[m]);
+}
+
+// Main ... process args, tune and rebuild signatures
+
+int main(int argc, char **argv)
+{
+	Reln r;  // open relation info
+	char err[MAXERRMSG];  // buffer for error messages
+	Bool rebuild = TRUE;  // rebuild signatures with the new parameters?
+
+	// process command-line args
+
+	int nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+	while (argc > 1 && argv[1][0] == '-') {
+		if (strcmp(argv[1], "-n") == 0)
+			rebuild = FALSE;
+		else if (strcmp(argv[1], "-j") == 0 && argc > 2) {
+			nthreads = atoi(argv[2]);
+			argc--; argv++;
+		}
+		else
+			fatal(USAGE, "");
+		argc--; argv++;
+	}
+	if (argc < 3) fatal(USAGE, "");
+	if (nthreads < 1) {
+		sprintf(err, "Invalid #threads: %d (must be >= 1)", nthreads);
+		fatal("", err);
+	}
+	char *name = argv[1];
+
+	if ((r = openRelationSnapshot(name)) == NULL) {
+		sprintf(err, "Can't open relation: %s",name);
+		fatal("", err);
+	}
+	float pF = r->params.pF;
+	if (argc > 3) {
+		pF = 1.0 / atoi(argv[3]);
+		if (pF > 0.01) {
+			sprintf(err, "Invalid pF: %f (must be > 100)", pF);
+			fatal("", err);
+		}
+	}
+
+	FILE *log = fopen(argv[2], "r");
+	if (log == NULL) {
+		sprintf(err, "Can't open query log: %s", argv[2]);
+		fatal("", err);
+	}
+	Workload w;
+	readWorkload(r, log, &w);
+	fclose(log);
+	if (w.ndisjuncts == w.masks[0])
+		fatal("", "No logged query knows any attribute's value");
+
+	Params old, new;
+	currentParams(r, &old);
+	chooseParams(r, &w, pF, &new);
+	showParams(r, &w, &old, &new, pF);
+	closeRelation(r);
+
+	double est[NMETHODS];
+	BigCount actual[NMETHODS];
+	printf("Page reads for the logged queries:\n");
+	printf("  %-6s  %c  %12s  %10s\n", "", ' ', "estimated", "measured");
+	pageReads(name, &w, est, actual);
+	showPageReads("before", est, actual);
+	if (rebuild) {
+		if (rebuildSignatures(name, new.sigtype, pF, new.tk, new.tm, new.pm, new.bm,
+		                      new.bits, nthreads) != OK) {
+			sprintf(err, "Can't rebuild signatures for %s (signatures too large for pages?)", name);
+			fatal("", err);
+		}
+		pageReads(name, &w, est, actual);
+		showPageReads("after", est, actual);
+	}
+
+	for (Count i = 0; i < w.nqueries; i++)
+		free(w.queries[i]);
+	free(w.queries);
+	return 0;
+}
@@ -1,7 +1,17 @@
 // tuple.c ... functions on tuples
 // part of signature indexed files
 // Written by John Shepherd, March 2019
+//
+// Typed relations (TYPED_TUPLES) store each tuple as its attributes'
+// binary values, packed one after another with no separators:
+// an int32 or int64 attribute in native byte order, and a char(n)
+// attribute as n bytes, padded with '\0'. "?" is stored as the
+// smallest integer of its type, or as the text "?". Tuples are
+// packed by addTupleToPage and turned back into text by
+// getTupleFromPage, so the rest of the system only sees text.
 
+#include <stdint.h>
+#include <errno.h>
 #include "defs.h"
 #include "tuple.h"
 #include "reln.h"
@@ -16,16 +26,153 @@ Tuple readTuple(Reln r, FILE *in)
 	if (fgets(line, MAXTUPLEN-1, in) == NULL)
 		return NULL;
 	line[strlen(line)-1] = '\0';
-	// count fields
-	// cheap'n'nasty parsing
-	char *c; int nf = 1;
-	for (c = line; *c != '\0'; c++)
-		if (*c == ',') nf++;
-	// invalid tuple
-	if (nf != nAttrs(r)) return NULL;
+	// a malformed line is still returned, for validTuple to reject;
+	// NULL means end of input
 	return strdup(line); // needs to be free'd sometime
 }
 
+// value of an integer attribute of the given type, in *v
+// FALSE if val is not an integer of that type
+
+static Bool parseIntVal(char type, char *val, long long *v)
+{
+	if (!isNumericVal(val)) return FALSE;
+	errno = 0;
+	*v = strtoll(val, NULL, 10);
+	if (errno == ERANGE) return FALSE;
+	// the smallest value of each type stands for "?"
+	if (type == INT32_ATTR)
+		return *v > INT32_MIN && *v <= INT32_MAX;
+	return *v > INT64_MIN;
+}
+
+// how many comma-separated fields in t
+
+static Count nFields(Tuple t)
+{
+	Count nf = 1;
+	for (char *c = t; *c != '\0'; c++)
+		if (*c == ',') nf++;
+	return nf;
+}
+
+// can t be stored in relation r?
+// it needs one field per attribute; untyped tuples have a fixed
+// size, and typed ones need each value to fit its attribute's type
+// ("?" fits any attribute)
+
+Bool validTuple(Reln r, Tuple t)
+{
+	if (nFields(t) != nAttrs(r)) return FALSE;
+	if (!hasOption(r, TYPED_TUPLES)) return strlen(t) == tupSize(r);
+	char **vals = tupleVals(r, t);
+	Bool ok = TRUE;
+	for (Count i = 0; ok && i < nAttrs(r); i++) {
+		long long v;
+		if (isUnknownVal(vals[i])) continue;
+		if (isIntAttr(r, i))
+			ok = parseIntVal(attrType(r, i), vals[i], &v);
+		else
+			ok = strlen(vals[i]) <= r->params.attrLen[i];
+	}
+	freeVals(vals, nAttrs(r));
+	return ok;
+}
+
+// value of the integer field at f, of the given type, in *v
+// FALSE if the field holds "?"
+
+Bool intFieldValue(char type, Byte *f, long long *v)
+{
+	if (type == INT32_ATTR) {
+		int32_t x;
+		memcpy(&x, f, sizeof(x));
+		*v = x;
+		return x != INT32_MIN;
+	}
+	int64_t x;
+	memcpy(&x, f, sizeof(x));
+	*v = x;
+	return x != INT64_MIN;
+}
+
+// pack the values of text tuple t into buf (tupSize(r) bytes)
+
+static void packTuple(Reln r, Tuple t, Byte *buf)
+{
+	char **vals = tupleVals(r, t);
+	memset(buf, 0, tupSize(r));
+	for (Count i = 0; i < nAttrs(r); i++) {
+		Count len = r->params.attrLen[i];
+		long long v;
+		if (!isIntAttr(r, i))
+			memcpy(buf, vals[i], strnlen(vals[i], len));
+		else if (attrType(r, i) == INT32_ATTR) {
+			int32_t x = parseIntVal(INT32_ATTR, vals[i], &v) ? v : INT32_MIN;
+			memcpy(buf, &x, sizeof(x));
+		}
+		else {
+			int64_t x = parseIntVal(INT64_ATTR, vals[i], &v) ? v : INT64_MIN;
+			memcpy(buf, &x, sizeof(x));
+		}
+		buf += len;
+	}
+	freeVals(vals, nAttrs(r));
+}
+
+// text version of the packed tuple at buf
+
+static Tuple unpackTuple(Reln r, Byte *buf)
+{
+	char text[MAXTUPLEN*2];
+	int n = 0;
+	for (Count i = 0; i < nAttrs(r); i++) {
+		Count len = r->params.attrLen[i];
+		long long v;
+		if (i > 0) text[n++] = ',';
+		if (!isIntAttr(r, i))
+			n += snprintf(&text[n], sizeof(text)-n, "%.*s", (int)len, (char *)buf);
+		else if (intFieldValue(attrType(r, i), buf, &v))
+			n += snprintf(&text[n], sizeof(text)-n, "%lld", v);
+		else
+			n += snprintf(&text[n], sizeof(text)-n, "?");
+		buf += len;
+	}
+	return strdup(text);
+}
+
+// records hold text tuples, so for a typed relation they have
+// the size of its untyped tuples
+
+static Count recordSize(Reln r)
+{
+	return hasOption(r, TYPED_TUPLES) ? TEXT_TUPSIZE(nAttrs(r)) : tupSize(r);
+}
+
+// check the header of a file of tuple records
+
+Bool readRecordHeader(Reln r, FILE *in)
+{
+	RecordHeader h;
+	if (fread(&h, sizeof(h), 1, in) != 1) return FALSE;
+	return h.magic == RECORD_MAGIC && h.nattrs == nAttrs(r) && h.tupsize == recordSize(r);
+}
+
+// read one fixed-size tuple record
+
+Tuple readTupleRecord(Reln r, FILE *in)
+{
+	Count size = recordSize(r);
+	Tuple t = malloc(size + 1);
+	assert(t != NULL);
+	if (fread(t, size, 1, in) != 1) {
+		free(t);
+		return NULL;
+	}
+	t[size] = '\0';
+	return t;
+}
+
 // extract values into an array of strings
 
 char **tupleVals(Reln r, Tuple t)
@@ -61,7 +208,20 @@ void freeVals(char **vals, int nattrs)
         free(vals);
 }
 
+// is val inside the (inclusive) range "lo..hi"?
+
+static Bool inRange(char *val, char *range)
+{
+	char lo[MAXTUPLEN], hi[MAXTUPLEN];
+	rangeBounds(range, lo, hi, MAXTUPLEN);
+	if (lo[0] != '\0' && compareVals(val, lo) < 0) return FALSE;
+	if (hi[0] != '\0' && compareVals(val, hi) > 0) return FALSE;
+	return TRUE;
+}
+
 // compare two tuples (allowing for "unknown" values)
+// and range values "lo..hi" or patterns "ab*" in the second tuple
+// integer attributes of a typed relation compare as numbers
 
 Bool tupleMatch(Reln r, Tuple t1, Tuple t2)
 {
@@ -73,6 +233,10 @@ Bool tupleMatch(Reln r, Tuple t1, Tuple t2)
 	for (i = 0; i < n; i++) {
 		if (v1[i][0] == '?' || v2[i][0] == '?') continue;
 		if (strcmp(v1[i],v2[i]) == 0) continue;
+		if (isIntAttr(r, i) && isNumericVal(v1[i]) && isNumericVal(v2[i])
+		    && compareVals(v1[i], v2[i]) == 0) continue;
+		if (isRangeVal(v2[i]) && inRange(v1[i], v2[i])) continue;
+		if (isPatternVal(v2[i]) && matchPattern(v1[i], v2[i])) continue;
 		match = FALSE;
 	}
 	freeVals(v1,n); freeVals(v2,n);
@@ -87,7 +251,10 @@ Status addTupleToPage(Reln r, Page p, Tuple t)
 	if (pageNitems(p) == maxTupsPP(r)) return NOT_OK;
 	int size = tupSize(r);
 	Byte *addr = addrInPage(p, pageNitems(p), size);
-	memcpy(addr, t, size);
+	if (hasOption(r, TYPED_TUPLES))
+		packTuple(r, t, addr);
+	else
+		memcpy(addr, t, size);
 	addOneItem(p);
 	return OK;
 }
@@ -100,12 +267,47 @@ Tuple getTupleFromPage(Reln r, Page p, int i)
 	assert(i <= pageNitems(p));
 	int size = tupSize(r);
 	Byte *addr = addrInPage(p, i, size);
+	if (hasOption(r, TYPED_TUPLES)) return unpackTuple(r, addr);
 	Tuple tup = malloc(size+1);
 	memcpy(tup, addr, size);
 	tup[size] = '\0';
 	return tup;
 }
 
+// Each data page ends with a tombstone bitmap: one bit per tuple
+// slot (tupPP bits); a set bit means the tuple has been deleted
+
+static Byte *tombstones(Reln r, Page p)
+{
+	int nbytes = iceil(maxTupsPP(r), 8);
+	return addrInPage(p, pageSize(r) - sizeof(Count) - nbytes, 1);
+}
+
+// has i'th tuple in Page been deleted?
+
+Bool tupleIsDeleted(Reln r, Page p, int i)
+{
+	assert(r != NULL && p != NULL && i < maxTupsPP(r));
+	return (tombstones(r, p)[i/8] & (1 << (i%8))) != 0;
+}
+
+void markTupleDeleted(Reln r, Page p, int i)
+{
+	assert(r != NULL && p != NULL && i < maxTupsPP(r));
+	tombstones(r, p)[i/8] |= (1 << (i%8));
+}
+
+// does Page contain any deleted tuples?
+
+Bool pageHasDeleted(Reln r, Page p)
+{
+	Byte *tomb = tombstones(r, p);
+	for (int i = 0; i < iceil(maxTupsPP(r), 8); i++) {
+		if (tomb[i] != 0) return TRUE;
+	}
+	return FALSE;
+}
+
 // display printable version of tuple on stdout
 
 void showTuple(Reln r, Tuple t)
@@ -116,3 +318,90 @@ void showTuple(Reln r, Tuple t)
 Bool isUnknownVal(char *val) {
         return strcmp(val, "?") == 0;
 }
+
+// range values look like "lo..hi", "lo.." or "..hi"
+
+Bool isRangeVal(char *val) {
+        return strstr(val, "..") != NULL;
+}
+
+// pattern values contain '*' (any sequence of chars)
+// e.g. "abc*" (prefix), "*abc" (suffix), "*abc*" (substring)
+
+Bool isPatternVal(char *val) {
+        return strchr(val, '*') != NULL;
+}
+
+// does val match the pattern pat?
+
+Bool matchPattern(char *val, char *pat)
+{
+        if (*pat == '\0') return *val == '\0';
+        if (*pat == '*') {
+                for (char *v = val; ; v++) {
+                        if (matchPattern(v, pat+1)) return TRUE;
+                        if (*v == '\0') return FALSE;
+                }
+        }
+        return *val == *pat && matchPattern(val+1, pat+1);
+}
+
+// split a range value into its bounds
+// a missing bound is returned as ""
+// bounds longer than size-1 chars are truncated
+
+Bool rangeBounds(char *val, char *lo, char *hi, int size)
+{
+        char *dots = strstr(val, "..");
+        if (dots == NULL) return FALSE;
+        int len = dots - val;
+        if (len > size-1) len = size-1;
+        memcpy(lo, val, len);
+        lo[len] = '\0';
+        snprintf(hi, size, "%s", dots+2);
+        return TRUE;
+}
+
+// is val an integer (optional '-' then digits)?
+
+Bool isNumericVal(char *val)
+{
+        if (*val == '-') val++;
+        if (*val == '\0') return FALSE;
+        for (; *val != '\0'; val++) {
+                if (*val < '0' || *val > '9') return FALSE;
+        }
+        return TRUE;
+}
+
+// ordering on attribute values
+// numbers compare numerically and sort before all other strings
+
+int compareVals(char *v1, char *v2)
+{
+        Bool n1 = isNumericVal(v1), n2 = isNumericVal(v2);
+        if (n1 && n2) {
+                long long x1 = atoll(v1), x2 = atoll(v2);
+                return (x1 < x2) ? -1 : (x1 > x2);
+        }
+        if (n1 != n2) return n1 ? -1 : 1;
+        return strcmp(v1, v2);
+}
+
+// hash of value val of attribute i, for codewords and the hash index
+// an integer attribute of a typed relation hashes its binary value,
+// so e.g. "42" and "042" hash alike; anything else hashes its text
+
+Word valueHash(Reln r, Count i, char *val)
+{
+        long long v;
+        if (isIntAttr(r, i) && parseIntVal(attrType(r, i), val, &v)) {
+                if (attrType(r, i) == INT32_ATTR) {
+                        int32_t x = v;
+                        return hash_any((char *)&x, sizeof(x));
+                }
+                int64_t x = v;
+                return hash_any((char *)&x, sizeof(x));
+        }
+        return hash_any(val, strlen(val));
+}
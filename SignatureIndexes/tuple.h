@@ -2,6 +2,8 @@
 // part of signature indexed files
 // A Tuple is just a '\0'-terminated C string
 // Consists of "val_1,val_2,val_3,...,val_n"
+// (typed relations store tuples in binary, but read and
+// write them as text; see tuple.c)
 // See tuple.c for details on functions
 // Written by John Shepherd, March 2019
 
@@ -13,13 +15,38 @@ typedef char *Tuple;
 #include "reln.h"
 #include "page.h"
 
+// Files of fixed-size tuple records (e.g. from gendata -b) start
+// with a RecordHeader; each record is a tuple without its '\0'
+
+#define RECORD_MAGIC 0x53494754  // "TGIS"
+
+typedef struct _RecordHeader {
+	Count magic;
+	Count nattrs;
+	Count tupsize;
+} RecordHeader;
+
 Tuple readTuple(Reln r, FILE *f);
+Bool validTuple(Reln r, Tuple t);
+Bool readRecordHeader(Reln r, FILE *f);
+Tuple readTupleRecord(Reln r, FILE *f);
 char **tupleVals(Reln r, Tuple t);
 void freeVals(char **vals, int nattrs);
 Bool tupleMatch(Reln r, Tuple t1, Tuple t2);
 Status addTupleToPage(Reln r, Page p, Tuple t);
 Tuple getTupleFromPage(Reln r, Page p, int i);
+Bool tupleIsDeleted(Reln r, Page p, int i);
+void markTupleDeleted(Reln r, Page p, int i);
+Bool pageHasDeleted(Reln r, Page p);
 void showTuple(Reln r, Tuple t);
 Bool isUnknownVal(char *val);
+Bool isRangeVal(char *val);
+Bool isPatternVal(char *val);
+Bool matchPattern(char *val, char *pat);
+Bool rangeBounds(char *val, char *lo, char *hi, int size);
+Bool isNumericVal(char *val);
+int compareVals(char *v1, char *v2);
+Word valueHash(Reln r, Count i, char *val);
+Bool intFieldValue(char type, Byte *f, long long *v);
 
 #endif
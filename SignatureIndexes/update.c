@@ -0,0 +1,70 @@
+// update.c ... update tuples in a relation
+// part of signature indexed files
+// Replaces tuples matching a query by new versions in which
+// each non-"?" value in Changes replaces the old value
+// (values must keep their length, as tuples are fixed-size);
+// tuples whose new values don't fit are reported and left as
+// they were, and the exit status is then 1
+// Old versions are deleted (tombstones); new versions are appended
+// Usage:  ./update  [-v]  RelName  v1,v2,v3,v4,...  Changes  [t|p|b|h|r|a]
+
+#include "defs.h"
+#include "query.h"
+#include "tuple.h"
+#include "reln.h"
+
+#define USAGE "./update  [-v]  RelName  v1,v2,v3,v4,...  c1,c2,c3,c4,...  [t|p|b|h|r|a]"
+
+// Main ... process args, update tuples
+
+int main(int argc, char **argv)
+{
+	Reln r;       // open relation info
+	Query q;      // query iteration information
+	int verbose;  // show each new tuple version
+	char *rname;  // name of table/file
+	char *qstr;   // query string
+	char *changes; // new attribute values
+	char  type = 'a';   // type of signatures to use
+	char err[MAXERRMSG];  // buffer for error messages
+
+	// process command-line args
+
+	if (argc < 4) fatal(USAGE, "");
+	if (strcmp(argv[1], "-v") == 0) {
+		verbose = 1;  argc--; argv++;
+	}
+	else
+		verbose = 0;
+	if (argc < 4) fatal(USAGE, "");
+	rname = argv[1];  qstr = argv[2];  changes = argv[3];
+	if (argc > 4) type = argv[4][0];
+
+	// initialise relation and scan descriptors
+
+	if ((r = openRelation(rname)) == NULL) {
+		sprintf(err, "Can't open relation: %s",rname);
+		fatal("", err);
+	}
+	if ((q = startQuery(r, qstr, type)) == NULL) {
+		sprintf(err, "Invalid query: %s",qstr);
+		fatal("",err);
+	}
+
+	q->display = verbose;
+	BigCount n;
+	if (updateMatchingTuples(q, changes, &n) != OK) {
+		sprintf(err, "Invalid changes: %s",changes);
+		fatal("",err);
+	}
+	printf("Updated %llu tuples\n", n);
+	if (q->nskipped > 0)
+		printf("Skipped %llu tuples whose new values don't fit\n", q->nskipped);
+
+	// clean up
+	Bool skipped = (q->nskipped > 0);
+	closeQuery(q);
+	closeRelation(r);
+
+	return skipped ? 1 : 0;
+}
@@ -7,7 +7,7 @@
 #ifndef UTIL_H
 #define UTIL_H 1
 
-void fatal(char *, char *);
+void fatal(char *, char *) __attribute__((noreturn));
 int  iceil(int, int);
 
 #endif
@@ -0,0 +1,35 @@
+// vacuum.c ... reclaim space used by deleted tuples
+// part of signature indexed files
+// Rewrites data pages holding deleted tuples, one page at a time,
+// and rebuilds the signatures and index entries for those pages
+// Usage:  ./vacuum  RelName
+
+#include "defs.h"
+#include "reln.h"
+
+#define USAGE "./vacuum  RelName"
+
+// Main ... process args, vacuum relation
+
+int main(int argc, char **argv)
+{
+	Reln r;  // open relation info
+	char err[MAXERRMSG];  // buffer for error messages
+
+	// process command-line args
+
+	if (argc < 2) fatal(USAGE, "");
+
+	if ((r = openRelation(argv[1])) == NULL) {
+		sprintf(err, "Can't open relation: %s",argv[1]);
+		fatal("", err);
+	}
+
+	BigCount n = vacuumRelation(r);
+	printf("Removed %llu deleted tuples\n", n);
+
+	// clean up
+
+	closeRelation(r);
+	return 0;
+}
@@ -0,0 +1,247 @@
+// zone.c ... functions on per-page zone maps
+// part of signature indexed files
+// A zone map summarises the numeric values on one data page: for
+// each attribute, whether all its values on the page are numbers
+// and, if so, their min and max. Entries are stored by data page
+// (zonePP per page); each has the layout
+//   Count ntuples, Count numeric, long long min[nattrs], max[nattrs]
+// Entries only ever widen as tuples are added (deleted tuples stay
+// in them until the page is vacuumed), so they never rule out a
+// page that holds a matching tuple.
+// A query bounding numeric values (e.g. "1000..2000" or "1234")
+// skips pages whose [min,max] for that attribute can't match.
+
+#include <unistd.h>
+#include <limits.h>
+#include "defs.h"
+#include "reln.h"
+#include "query.h"
+#include "tuple.h"
+#include "zone.h"
+
+#define MAX_ZONE_ATTRS 9  // = max #attrs
+
+typedef struct _Zone {
+	Count     ntuples;   // tuples summarised (incl. deleted ones)
+	Count     numeric;   // bit i set: all values of attribute i are numbers
+	long long min[MAX_ZONE_ATTRS];
+	long long max[MAX_ZONE_ATTRS];
+} Zone;
+
+// numeric values an attribute of a query disjunct allows
+
+typedef struct _Bound {
+	Bool      bound;     // does the query value restrict numbers at all?
+	Bool      none;      // it can't match any number
+	long long lo, hi;
+} Bound;
+
+static void getZone(Reln r, Page p, Count slot, Zone *z)
+{
+	Count n = nAttrs(r);
+	Byte *addr = addrInPage(p, slot, r->params.zoneSize);
+	memcpy(&z->ntuples, addr, sizeof(Count));
+	memcpy(&z->numeric, addr + sizeof(Count), sizeof(Count));
+	addr += 2*sizeof(Count);
+	memcpy(z->min, addr, n*sizeof(long long));
+	memcpy(z->max, addr + n*sizeof(long long), n*sizeof(long long));
+}
+
+// write the zone map entry of data page pid
+
+static void putZone(Reln r, PageID pid, Zone *z)
+{
+	RelnParams *rp = &(r->params);
+	PageID zpid = pid / rp->zonePP;
+	Count slot = pid % rp->zonePP;
+	Count n = nAttrs(r);
+	while (zpid >= rp->zoneNpages) {
+		Page p = getNewLastPage(&rp->zoneNpages, r->zonef);
+		free(p);
+	}
+	Page p = getPage(r->zonef, zpid);
+	Byte *addr = addrInPage(p, slot, rp->zoneSize);
+	memcpy(addr, &z->ntuples, sizeof(Count));
+	memcpy(addr + sizeof(Count), &z->numeric, sizeof(Count));
+	addr += 2*sizeof(Count);
+	memcpy(addr, z->min, n*sizeof(long long));
+	memcpy(addr + n*sizeof(long long), z->max, n*sizeof(long long));
+	while (pageNitems(p) <= slot)
+		addOneItem(p);
+	putPage(r->zonef, zpid, p);
+}
+
+// widen zone z to cover tuple t
+
+static void addToZone(Reln r, Zone *z, Tuple t)
+{
+	char **vals = tupleVals(r, t);
+	if (z->ntuples == 0)
+		z->numeric = (1 << nAttrs(r)) - 1;
+	for (Count i = 0; i < nAttrs(r); i++) {
+		if (!isNumericVal(vals[i])) {
+			z->numeric &= ~(1 << i);
+			continue;
+		}
+		long long x = atoll(vals[i]);
+		if (z->ntuples == 0 || x < z->min[i]) z->min[i] = x;
+		if (z->ntuples == 0 || x > z->max[i]) z->max[i] = x;
+	}
+	z->ntuples++;
+	freeVals(vals, nAttrs(r));
+}
+
+// add zone maps to a relation and build them
+// from the tuples already in the data file
+
+void newZoneMaps(Reln r)
+{
+	RelnParams *rp = &(r->params);
+	rp->options |= ZONE_MAPS;
+	rp->zoneNpages = 0;
+	rp->zoneSize = 2*sizeof(Count) + 2*nAttrs(r)*sizeof(long long);
+	rp->zonePP = (pageSize(r)-sizeof(Count)) / rp->zoneSize;
+	openZoneMaps(r);
+	int ok = ftruncate(r->zonef, 0);
+	assert(ok == 0);
+	for (PageID pid = 0; pid < nPages(r); pid++) {
+		Page p = getPage(dataFile(r), pid);
+		resetZoneMap(r, pid, p);
+		free(p);
+	}
+}
+
+void openZoneMaps(Reln r)
+{
+	r->zonef = openRelnFile(r, "zone");
+}
+
+void closeZoneMaps(Reln r)
+{
+	if (r->zonef >= 0) close(r->zonef);
+	r->zonef = -1;
+}
+
+// widen the zone map entry of data page pid to cover tuple t
+
+void addToZoneMap(Reln r, PageID pid, Tuple t)
+{
+	RelnParams *rp = &(r->params);
+	Zone z;
+	memset(&z, 0, sizeof(z));
+	if (pid / rp->zonePP < rp->zoneNpages) {
+		Page p = getPage(r->zonef, pid / rp->zonePP);
+		if (pid % rp->zonePP < pageNitems(p))
+			getZone(r, p, pid % rp->zonePP, &z);
+		free(p);
+	}
+	addToZone(r, &z, t);
+	putZone(r, pid, &z);
+}
+
+// recompute the zone map entry of data page pid
+// from the live tuples in its page p
+
+void resetZoneMap(Reln r, PageID pid, Page p)
+{
+	Zone z;
+	memset(&z, 0, sizeof(z));
+	for (Count i = 0; i < pageNitems(p); i++) {
+		if (tupleIsDeleted(r, p, i)) continue;
+		Tuple t = getTupleFromPage(r, p, i);
+		addToZone(r, &z, t);
+		free(t);
+	}
+	putZone(r, pid, &z);
+}
+
+// which numbers can match query value val? (see tupleMatch)
+// a range with a non-numeric bound follows compareVals, in which
+// numbers sort before all other strings
+
+static void numericBound(char *val, Bound *b)
+{
+	b->bound = TRUE; b->none = FALSE;
+	b->lo = LLONG_MIN; b->hi = LLONG_MAX;
+	if (isUnknownVal(val) || isPatternVal(val)) {
+		b->bound = FALSE;
+	}
+	else if (isRangeVal(val)) {
+		char lo[MAXTUPLEN], hi[MAXTUPLEN];
+		rangeBounds(val, lo, hi, MAXTUPLEN);
+		if (lo[0] != '\0') {
+			if (isNumericVal(lo)) b->lo = atoll(lo);
+			else b->none = TRUE;
+		}
+		if (hi[0] != '\0' && isNumericVal(hi)) b->hi = atoll(hi);
+		if (lo[0] == '\0' && (hi[0] == '\0' || !isNumericVal(hi)))
+			b->bound = FALSE;
+	}
+	else if (isNumericVal(val))
+		b->lo = b->hi = atoll(val);
+	else
+		b->none = TRUE;
+}
+
+// could a tuple summarised by z match a disjunct with bounds b?
+
+static Bool zoneMayMatch(Reln r, Zone *z, Bound *b)
+{
+	if (z->ntuples == 0) return FALSE;
+	for (Count i = 0; i < nAttrs(r); i++) {
+		if (!b[i].bound || !(z->numeric & (1 << i))) continue;
+		if (b[i].none || z->max[i] < b[i].lo || z->min[i] > b[i].hi)
+			return FALSE;
+	}
+	return TRUE;
+}
+
+// find the data pages that could hold tuples matching query q
+// the last data page is always kept, since a writer may be widening
+// its entry as it is read (see openRelationSnapshot)
+// returns NULL if the relation has no zone maps, or some disjunct
+// bounds no attribute numerically (so that few pages could be skipped)
+
+Bits findPagesUsingZoneMaps(Query q)
+{
+	Reln r = q->rel;
+	RelnParams *rp = &(r->params);
+	if (!hasOption(r, ZONE_MAPS)) return NULL;
+
+	Bound *bounds = malloc(q->ndisjuncts * nAttrs(r) * sizeof(Bound));
+	assert(bounds != NULL);
+	for (Count d = 0; d < q->ndisjuncts; d++) {
+		Bound *b = bounds + d*nAttrs(r);
+		char **vals = tupleVals(r, q->disjuncts[d]);
+		Bool any = FALSE;
+		for (Count i = 0; i < nAttrs(r); i++) {
+			numericBound(vals[i], &b[i]);
+			any = any || b[i].bound;
+		}
+		freeVals(vals, nAttrs(r));
+		if (!any) {
+			free(bounds);
+			return NULL;
+		}
+	}
+
+	Bits pages = newBits(nPages(r));
+	setAllBits(pages);
+	for (PageID zpid = 0; zpid < rp->zoneNpages; zpid++) {
+		Page p = getPage(r->zonef, zpid);
+		q->nsigpages++;
+		for (Count slot = 0; slot < pageNitems(p); slot++) {
+			PageID pid = zpid*rp->zonePP + slot;
+			if (pid >= nPages(r)-1) break;
+			Zone z;
+			getZone(r, p, slot, &z);
+			Bool keep = FALSE;
+			for (Count d = 0; !keep && d < q->ndisjuncts; d++)
+				keep = zoneMayMatch(r, &z, bounds + d*nAttrs(r));
+			if (!keep) unsetBit(pages, pid);
+		}
+		free(p);
+	}
+	free(bounds);
+	return pages;
+}
@@ -0,0 +1,20 @@
+// zone.h ... interface to functions on per-page zone maps
+// part of signature indexed files
+// See zone.c for details of the file layout
+
+#ifndef ZONE_H
+#define ZONE_H 1
+
+#include "defs.h"
+#include "query.h"
+#include "reln.h"
+#include "bits.h"
+
+void newZoneMaps(Reln);
+void openZoneMaps(Reln);
+void closeZoneMaps(Reln);
+void addToZoneMap(Reln, PageID, Tuple);
+void resetZoneMap(Reln, PageID, Page);
+Bits findPagesUsingZoneMaps(Query);
+
+#endif